@@ -0,0 +1,125 @@
+Import("env")
+
+# Collects the tag and format string of every LOG_E/W/I/D/T call into log_formats.json (in the
+# build directory), keyed by the format id the firmware sends in binary log mode (-DLOG_BINARY,
+# see src/common/log_binary.h). tools/log_decoder.py renders binary logs with it.
+
+import json
+import os
+import re
+
+LOG_CALL = re.compile(r"\bLOG_([EWIDT])\s*\(")
+STRING_DEFINE = re.compile(r'^[ \t]*#[ \t]*define[ \t]+(\w+)[ \t]+((?:"(?:[^"\\\n]|\\.)*"[ \t]*)+)$', re.M)
+SOURCE_EXTENSIONS = (".c", ".cpp", ".h", ".hpp", ".tpp", ".ino")
+SIMPLE_ESCAPES = {"n": 10, "t": 9, "r": 13, "a": 7, "b": 8, "f": 12, "v": 11, "\\": 92, '"': 34, "'": 39, "?": 63}
+
+
+def fnv1a(data, value=2166136261):
+    for byte in data:
+        value = ((value ^ byte) * 16777619) & 0xFFFFFFFF
+    return value
+
+
+def format_id(tag, fmt):
+    value = fnv1a(fmt, ((fnv1a(tag) ^ 0x1F) * 16777619) & 0xFFFFFFFF)
+    return value or 1
+
+
+def unescape(literal):
+    """Bytes of the body of a C string literal, as the compiler stores them."""
+    out = bytearray()
+    i = 0
+    while i < len(literal):
+        char = literal[i]
+        if char != "\\":
+            out += char.encode("utf-8")
+            i += 1
+            continue
+        char = literal[i + 1]
+        if char in SIMPLE_ESCAPES:
+            out.append(SIMPLE_ESCAPES[char])
+            i += 2
+        elif char == "x":
+            digits = re.match(r"[0-9a-fA-F]+", literal[i + 2:]).group(0)
+            out.append(int(digits, 16) & 0xFF)
+            i += 2 + len(digits)
+        else:
+            digits = re.match(r"[0-7]{1,3}", literal[i + 1:]).group(0)
+            out.append(int(digits, 8) & 0xFF)
+            i += 1 + len(digits)
+    return bytes(out)
+
+
+def parse_literals(text, pos, defines):
+    """Parses adjacent string literals and string macros up to the next ',' or ')'.
+    Returns (bytes, position of the delimiter), or (None, pos) if the argument isn't a literal."""
+    value = b""
+    found = False
+    while pos < len(text):
+        char = text[pos]
+        if char.isspace():
+            pos += 1
+        elif char == '"':
+            match = re.compile(r'"((?:[^"\\\n]|\\.)*)"').match(text, pos)
+            if not match:
+                return None, pos
+            value += unescape(match.group(1))
+            found = True
+            pos = match.end()
+        elif char.isalpha() or char == "_":
+            match = re.compile(r"\w+").match(text, pos)
+            if match.group(0) not in defines:
+                return None, pos
+            value += defines[match.group(0)]
+            found = True
+            pos = match.end()
+        elif char in ",)":
+            return (value if found else None), pos
+        else:
+            return None, pos
+    return None, pos
+
+
+def source_files():
+    for directory in (env.subst("$PROJECT_SRC_DIR"), env.subst("$PROJECT_INCLUDE_DIR"), os.path.join(env.subst("$PROJECT_DIR"), "lib")):
+        for root, _, files in os.walk(directory):
+            for name in sorted(files):
+                if name.endswith(SOURCE_EXTENSIONS):
+                    yield os.path.join(root, name)
+
+
+def collect_log_formats():
+    sources = {path: open(path, encoding="utf-8", errors="replace").read() for path in source_files()}
+
+    defines = {}
+    for text in sources.values():
+        for name, literals in STRING_DEFINE.findall(text):
+            defines[name] = b"".join(unescape(body) for body in re.findall(r'"((?:[^"\\\n]|\\.)*)"', literals))
+
+    formats = {}
+    for path, text in sources.items():
+        for match in LOG_CALL.finditer(text):
+            tag, pos = parse_literals(text, match.end(), defines)
+            if tag is None or text[pos] != ",":
+                continue  # macro definitions, or a tag that isn't a literal
+            fmt, pos = parse_literals(text, pos + 1, defines)
+            if fmt is None:
+                print(f"[log formats] {path}:{text.count(chr(10), 0, match.start()) + 1}: format is not a literal, skipped")
+                continue
+
+            key = f"{format_id(tag, fmt):08x}"
+            entry = {"level": match.group(1), "tag": tag.decode("utf-8", "replace"), "format": fmt.decode("utf-8", "replace")}
+            if key in formats and (formats[key]["tag"], formats[key]["format"]) != (entry["tag"], entry["format"]):
+                print(f"[log formats] id collision between {formats[key]} and {entry}: reword one of them")
+                env.Exit(1)
+            entry["source"] = f"{os.path.relpath(path, env.subst('$PROJECT_DIR'))}:{text.count(chr(10), 0, match.start()) + 1}"
+            formats.setdefault(key, entry)
+
+    build_dir = env.subst("$BUILD_DIR")
+    os.makedirs(build_dir, exist_ok=True)
+    with open(os.path.join(build_dir, "log_formats.json"), "w") as file:
+        json.dump({"formats": formats}, file, indent=1, sort_keys=True)
+    print(f"[log formats] {len(formats)} formats written to {os.path.join(build_dir, 'log_formats.json')}")
+
+
+collect_log_formats()
@@ -27,7 +27,79 @@ def before_upload():
                 file.write(line)
 
 
+# Minifies and gzips every file in web/ into a table kept in flash (web_assets_data.h, in the build
+# directory), served by common/web_assets.cpp with Content-Encoding: gzip and an ETag.
+# "web/page.html" is served at "/page", "web/index.html" at "/", other files at their path.
+WEB_MIME_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".png": "image/png",
+    ".ico": "image/x-icon",
+    ".txt": "text/plain",
+}
+
+
+def minify(text, extension):
+    """Drops comments, indentation and blank lines; keep <pre> content and multi-line strings on one line."""
+    import re
+
+    if extension == ".html":
+        text = re.sub(r"<!--.*?-->", "", text, flags=re.S)
+    if extension == ".css":
+        text = re.sub(r"/\*.*?\*/", "", text, flags=re.S)
+    return "\n".join(line.strip() for line in text.splitlines() if line.strip())
+
+
+def embed_web_assets():
+    import gzip
+    import hashlib
+    import os
+
+    web_dir = os.path.join(env.subst("$PROJECT_DIR"), "web")
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "web_assets")
+    os.makedirs(out_dir, exist_ok=True)
+
+    arrays = []
+    entries = []
+    for root, _, files in sorted(os.walk(web_dir)) if os.path.isdir(web_dir) else []:
+        for name in sorted(files):
+            path = os.path.join(root, name)
+            relative = os.path.relpath(path, web_dir).replace(os.sep, "/")
+            base, extension = os.path.splitext(relative)
+            if extension not in WEB_MIME_TYPES:
+                print(f"[web assets] {relative}: unknown type, skipped")
+                continue
+
+            with open(path, "rb") as file:
+                data = file.read()
+            if WEB_MIME_TYPES[extension].startswith("text/") or extension in (".js", ".json", ".svg"):
+                data = minify(data.decode("utf-8"), extension).encode("utf-8")
+            compressed = gzip.compress(data, 9, mtime=0)
+            etag = '\\"' + hashlib.sha1(data).hexdigest()[:16] + '\\"'
+
+            url = "/" + (base if extension == ".html" else relative)
+            if url.endswith("/index") or url == "/index":
+                url = url[: -len("index")]
+
+            index = len(entries)
+            lines = [", ".join(f"0x{byte:02x}" for byte in compressed[i:i + 16]) for i in range(0, len(compressed), 16)]
+            arrays.append(f"static const uint8_t webAsset{index}[] PROGMEM = {{\n    " + ",\n    ".join(lines) + "};\n")
+            entries.append(f'    {{"{url}", "{WEB_MIME_TYPES[extension]}", webAsset{index}, {len(compressed)}, "{etag}"}},')
+            print(f"[web assets] {relative} -> {url}: {len(data)} bytes, {len(compressed)} gzipped")
+
+    with open(os.path.join(out_dir, "web_assets_data.h"), "w") as file:
+        file.write("// Generated by extra_script_pre.py from web/, do not edit\n\n")
+        file.write("\n".join(arrays))
+        file.write("\nstatic const WebAsset webAssets[] = {\n" + "\n".join(entries) + "\n};\n")
+        file.write(f"static const size_t webAssetCount = {len(entries)};\n")
+    env.Append(CPPPATH=[out_dir])
+
+
 # env.AddPreAction("upload", before_upload)
 # env.AddPreAction("buildprog", before_upload)
 
 before_upload()
+embed_web_assets()
@@ -0,0 +1,161 @@
+#include "common/admission.h"
+
+struct TokenBucket
+{
+    uint32_t ip; // 0 when the bucket is free
+    uint32_t milliTokens;
+    uint32_t lastMillis;
+};
+static TokenBucket buckets[ADMISSION_CLIENTS];
+static uint32_t inFlight = 0;
+static uint32_t rateLimited = 0;
+static uint32_t busy = 0;
+
+// A request admitted, or an upload turned down, until its connection closes
+struct TrackedRequest
+{
+    AsyncWebServerRequest *request; // nullptr when the slot is free
+    AdmissionResult result;
+    ArDisconnectHandler onDisconnect; // the route handler's own, see onRequestDisconnect()
+};
+static TrackedRequest admitted[ADMISSION_MAX_IN_FLIGHT];
+static TrackedRequest rejectedUploads[ADMISSION_REJECTED_UPLOADS];
+
+static const char tooManyRequests[] PROGMEM = "Too many requests";
+static const char serviceUnavailable[] PROGMEM = "Busy, try again later";
+
+// The client's bucket, or the least recently used one started over for it
+static TokenBucket &bucketFor(uint32_t ip, uint32_t now)
+{
+    TokenBucket *oldest = &buckets[0];
+    for (TokenBucket &bucket : buckets)
+    {
+        if (bucket.ip == ip)
+            return bucket;
+        if (bucket.ip == 0 || (oldest->ip != 0 && now - bucket.lastMillis > now - oldest->lastMillis))
+            oldest = &bucket;
+    }
+    *oldest = {ip, ADMISSION_BURST * 1000u, now};
+    return *oldest;
+}
+
+static bool takeToken(uint32_t ip)
+{
+    uint32_t now = millis();
+    TokenBucket &bucket = bucketFor(ip, now);
+    uint32_t elapsed = std::min<uint32_t>(now - bucket.lastMillis, ADMISSION_BURST * 1000u);
+    bucket.milliTokens = std::min<uint32_t>(bucket.milliTokens + elapsed * ADMISSION_RATE_PER_S, ADMISSION_BURST * 1000u);
+    bucket.lastMillis = now;
+    if (bucket.milliTokens < 1000)
+        return false;
+    bucket.milliTokens -= 1000;
+    return true;
+}
+
+static void release(TrackedRequest *tracked)
+{
+    ArDisconnectHandler onDisconnect = std::move(tracked->onDisconnect);
+    if (tracked->result == ADMISSION_ACCEPTED)
+        inFlight--;
+    tracked->request = nullptr;
+    tracked->onDisconnect = nullptr;
+    if (onDisconnect)
+        onDisconnect();
+}
+
+template <size_t N>
+static TrackedRequest *track(TrackedRequest (&slots)[N], AsyncWebServerRequest *request, AdmissionResult result)
+{
+    for (TrackedRequest &slot : slots)
+    {
+        if (slot.request != nullptr)
+            continue;
+        slot.request = request;
+        slot.result = result;
+        TrackedRequest *tracked = &slot;
+        request->onDisconnect([tracked]()
+                              { release(tracked); });
+        return tracked;
+    }
+    return nullptr;
+}
+
+static TrackedRequest *findTracked(AsyncWebServerRequest *request)
+{
+    for (TrackedRequest &slot : admitted)
+        if (slot.request == request)
+            return &slot;
+    for (TrackedRequest &slot : rejectedUploads)
+        if (slot.request == request)
+            return &slot;
+    return nullptr;
+}
+
+static void reject(AsyncWebServerRequest *request, AdmissionResult result)
+{
+    bool limited = result == ADMISSION_RATE_LIMITED;
+    AsyncWebServerResponse *response = request->beginResponse_P(limited ? 429 : 503, "text/plain",
+                                                                limited ? tooManyRequests : serviceUnavailable);
+    response->addHeader("Retry-After", limited ? "1" : "2");
+    request->send(response);
+}
+
+AdmissionResult admitRequest(AsyncWebServerRequest *request, bool upload)
+{
+    TrackedRequest *tracked = findTracked(request);
+    if (tracked != nullptr)
+        return tracked->result; // decided on the upload's first chunk, and answered if turned down
+
+    AsyncClient *client = request->client();
+    if (client == nullptr)
+    {
+        busy++;
+        return ADMISSION_BUSY; // already disconnected
+    }
+    AdmissionResult result = ADMISSION_ACCEPTED;
+    if (!takeToken(static_cast<uint32_t>(client->remoteIP())))
+        result = ADMISSION_RATE_LIMITED;
+    else if (inFlight >= ADMISSION_MAX_IN_FLIGHT || ESP.getFreeHeap() < ADMISSION_MIN_FREE_HEAP)
+        result = ADMISSION_BUSY;
+
+    if (result == ADMISSION_ACCEPTED)
+    {
+        inFlight++; // a slot is free: there is one per request in flight
+        track(admitted, request, result);
+        return result;
+    }
+
+    if (result == ADMISSION_RATE_LIMITED)
+        rateLimited++;
+    else
+        busy++;
+    // An upload that can't be remembered is answered when its route handler asks again
+    if (!upload || track(rejectedUploads, request, result) != nullptr)
+        reject(request, result);
+    return result;
+}
+
+bool isRequestAdmitted(AsyncWebServerRequest *request)
+{
+    TrackedRequest *tracked = findTracked(request);
+    return tracked != nullptr && tracked->result == ADMISSION_ACCEPTED;
+}
+
+void onRequestDisconnect(AsyncWebServerRequest *request, ArDisconnectHandler handler)
+{
+    TrackedRequest *tracked = findTracked(request);
+    if (tracked != nullptr)
+        tracked->onDisconnect = handler;
+    else
+        request->onDisconnect(handler);
+}
+
+uint32_t getAdmissionInFlight()
+{
+    return inFlight;
+}
+
+uint32_t getAdmissionRejected(AdmissionResult reason)
+{
+    return reason == ADMISSION_RATE_LIMITED ? rateLimited : reason == ADMISSION_BUSY ? busy : 0;
+}
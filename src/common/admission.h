@@ -0,0 +1,51 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#ifdef ESP32
+#define ADMISSION_MAX_IN_FLIGHT 4           // requests being answered at once
+#define ADMISSION_MIN_FREE_HEAP (48 * 1024) // kept free for the TLS of an OTA check
+#elif defined(ESP8266)
+#define ADMISSION_MAX_IN_FLIGHT 2
+#define ADMISSION_MIN_FREE_HEAP (16 * 1024)
+#endif
+#define ADMISSION_CLIENTS 8      // clients with a token bucket, the least recently seen is reused
+#define ADMISSION_BURST 10       // requests a client can make at once
+#define ADMISSION_RATE_PER_S 2   // then this many per second
+#define ADMISSION_REJECTED_UPLOADS 4 // uploads turned down on their first chunk, remembered until they disconnect
+
+enum AdmissionResult : uint8_t
+{
+    ADMISSION_ACCEPTED,
+    ADMISSION_RATE_LIMITED, // 429: this client's bucket is empty
+    ADMISSION_BUSY          // 503: too many requests in flight, or too little free heap
+};
+
+/**
+ * Every route registered with registerRoutes() goes through admitRequest() first. A request is
+ * turned down when its client (by IP) has used up its token bucket, when ADMISSION_MAX_IN_FLIGHT
+ * requests are already being answered, or when free heap is below ADMISSION_MIN_FREE_HEAP.
+ * Rejections are answered with a 429 or 503 whose body stays in flash.
+ *
+ * Uploads are admitted on their first chunk (upload true), before any of the body is handled;
+ * the decision is kept for the request, and calling admitRequest() again for it returns the same
+ * one without answering twice.
+ *
+ * Requests are counted in flight until their connection closes (the server doesn't keep
+ * connections alive). Everything runs on the web server's task.
+ */
+AdmissionResult admitRequest(AsyncWebServerRequest *request, bool upload = false);
+bool isRequestAdmitted(AsyncWebServerRequest *request);
+
+/**
+ * Admission counts a request in flight until its onDisconnect callback, which holds a single
+ * handler: handlers of registered routes set theirs with this instead, it's called first.
+ */
+void onRequestDisconnect(AsyncWebServerRequest *request, ArDisconnectHandler handler);
+
+uint32_t getAdmissionInFlight();
+uint32_t getAdmissionRejected(AdmissionResult reason);
+
+#endif // ADMISSION_H
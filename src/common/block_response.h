@@ -0,0 +1,60 @@
+#ifndef BLOCK_RESPONSE_H
+#define BLOCK_RESPONSE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/**
+ * A 200 response streamed one block at a time: renderNext renders the next block in full (a
+ * metric, a route...), so that its values don't change halfway through, and the block is copied
+ * into the buffers handed over by the server as they come. Nothing is allocated per block.
+ * Chunked on HTTP/1.1.
+ */
+template <size_t BlockSize>
+class BlockResponse : public AsyncAbstractResponse
+{
+public:
+    BlockResponse(const char *contentType, bool chunked)
+    {
+        _code = 200;
+        _contentType = contentType;
+        _contentLength = 0;
+        _sendContentLength = false;
+        _chunked = chunked;
+    }
+    bool _sourceValid() const override { return true; }
+
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override
+    {
+        size_t written = 0;
+        while (written < maxLen)
+        {
+            if (blockOffset == blockLength)
+            {
+                if (done)
+                    break;
+                blockLength = renderNext(block, sizeof(block));
+                blockOffset = 0;
+                done = blockLength == 0;
+                continue;
+            }
+            size_t length = std::min(maxLen - written, blockLength - blockOffset);
+            memcpy(buf + written, block + blockOffset, length);
+            written += length;
+            blockOffset += length;
+        }
+        return written;
+    }
+
+protected:
+    // Writes the next block to block (size bytes) and returns its length, 0 once there's nothing left
+    virtual size_t renderNext(char *block, size_t size) = 0;
+
+private:
+    char block[BlockSize];
+    size_t blockLength = 0;
+    size_t blockOffset = 0;
+    bool done = false;
+};
+
+#endif // BLOCK_RESPONSE_H
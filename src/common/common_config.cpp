@@ -28,8 +28,11 @@ uint8_t minQuickRestartCountToEnterConfigMode = 2;
 // Wifi
 const char *configModeSsid = "ArduinoNet";
 const char *configModeHostname = "arduino";
-const uint32_t wifiConnectionStatusCheckMillis = 3 * 60 * 1000; // 3m
-const uint16_t wifiConnectionMaxMillis = 12 * 1000;             // 12s
+const uint32_t wifiConnectionStatusCheckMillis = 10 * 1000;      // 10s, in case a disconnection event is missed
+const uint16_t wifiConnectionMaxMillis = 12 * 1000;             // 12s, per attempt
+const uint8_t wifiConnectionMaxAttempts = 5;                    // then config mode
+const uint32_t wifiRetryBackoffMillis = 2 * 1000;               // 2s, doubled after each failed attempt
+const uint32_t wifiRadioResetMillis = 3 * 1000;                 // 3s, radio off before connecting again
 const IPAddress dns(8, 8, 8, 8);                                // Google's DNS
 
 // Ram Stats
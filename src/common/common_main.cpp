@@ -10,8 +10,15 @@
 #include "common/device_configuration.h"
 #include "common/eeprom_utils.tpp"
 #include "common/globals.h"
+#include "common/job_queue.h"
+#include "common/log_history.h"
+#include "common/log_uart.h"
+#include "common/metrics.h"
 #include "common/ota_handler.h"
+#include "common/response_cache.h"
 #include "common/server_handler.h"
+#include "common/telemetry_events.h"
+#include "common/utils.h"
 #include "common/wifi_handler.h"
 
 uint64_t lastLedFlashMillis = 0;
@@ -20,6 +27,7 @@ uint8_t quickRestartsCount;
 bool configMode = false;
 bool bootLoopMode = false;
 uint64_t configModeLastCheckMillis = 0;
+bool checkedForUpdateSinceBoot = false;
 ESPGithubOtaUpdate *updater = nullptr;
 
 void commonSetup()
@@ -35,12 +43,13 @@ void commonSetup()
 
     pinMode(integratedLEDPin, OUTPUT);
 
-    Serial.begin(115200);
+    beginLogUart(115200);
+    beginLogPipeline();
     LOG_PRINTLN(F("==============\n== Welcome! ==\n=============="));
+    LOG_I("main", "Boot #%u, reset reason: %s", getLogHistoryBootCount(), getResetReason().c_str());
 
-    // init EEPROM addresses
-    JUST_RESTARTED_EEPROM_ADDR = 0;
-    DEVICE_CONFIGURATION_EEPROM_ADDR = nextEepromSlot<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR);
+    // Bring stored structs written by older firmware to their current schema
+    migrateCommonDataOnEeprom();
 
     // Check whether it's a quick restart or the device config is not valid
     quickRestartsCount = readQuickRestartsFromEeprom();
@@ -50,7 +59,7 @@ void commonSetup()
         configMode = true;
         if (quickRestartsCount >= bootLoopModeMinCount)
         {
-            DEBUG_PRINTLN("Entering bootLoopMode as quickRestartCount = " + String(quickRestartsCount));
+            LOG_W("main", "Entering bootLoopMode as quickRestartCount = %u", quickRestartsCount);
             bootLoopMode = true;
         }
     }
@@ -63,20 +72,19 @@ void commonSetup()
     // Quick Restart
     saveQuickRestartsToEeprom(true);
 
-    // Wifi setup
-    if (!setupWifi())
-        configMode = true;
+    // Wifi setup, connects from the loop
+    beginWifi();
 
     // Server setup
+    registerCommonMetrics();
+    beginJobQueue();
     setupServer();
 
     // OTA Updater
     updater = new ESPGithubOtaUpdate(SW_VERSION, BINARY_NAME, releaseRepo, currentDeviceConfiguration->githubAuthToken);
-    updater->registerFirmwareUploadRoutes(webServer, &routeDescriptions);
-    if (!configMode)
-        updater->upgradeSoftware(); // Check and perform upgrade on startup
+    updater->registerFirmwareUploadRoutes(webServer);
 
-    LOG_PRINTLN("SW_VERSION: " + String(SW_VERSION));
+    LOG_I("main", "SW_VERSION: %s", SW_VERSION);
     LOG_PRINTLN("Common setup complete");
 }
 
@@ -91,6 +99,7 @@ void commonSetup()
 uint8_t commonLoop()
 {
     // Housekeeping //
+    loopTimingStart();
 
     // - Watchdog
 #ifdef ESP32
@@ -99,11 +108,9 @@ uint8_t commonLoop()
     ESP.wdtFeed();
 #endif
 
-    // LED flash
-    if (millis() - lastLedFlashMillis > ledFlashMinInterval)
+    // LED flash, once the UART is done sending: the LED is on the TX pin on ESP32
+    if (millis() - lastLedFlashMillis > ledFlashMinInterval && pauseLogUart())
     {
-        Serial.print("Alive signal flash LED: ");
-        Serial.flush();
         pinMode(integratedLEDPin, OUTPUT); // temporarely change pin mode
         lastLedFlashMillis = millis();
         for (int i = 0; i < 5; i++)
@@ -116,7 +123,8 @@ uint8_t commonLoop()
 #ifdef ESP32
         gpio_matrix_out(GPIO_NUM_1, U0TXD_OUT_IDX, false, false); // restore pin mode
 #endif
-        Serial.println();
+        resumeLogUart();
+        LOG_PRINTLN("Alive signal flash LED");
     }
 
     // - check if just restarted
@@ -124,38 +132,48 @@ uint8_t commonLoop()
     {
         saveQuickRestartsToEeprom(false);
         quickRestartsCount = 0;
+        bumpStateVersion();
     }
     // - check if in config mode but a valid configuration is found.
     // This covers the case where connection to WiFI was temporarily unsuccessful
     // but the configuration is valid so the rest of the code can be executed
-    if (configMode && !bootLoopMode && millis() - configModeLastCheckMillis > configModeCheckEveryMillis)
+    if (configMode && !bootLoopMode && !isJobRunning() && millis() - configModeLastCheckMillis > configModeCheckEveryMillis)
     {
         configModeLastCheckMillis = millis();
-        if (readDeviceConfigurationFromEeprom())
-        {
-            if (setupWifi())
-            {
-                configMode = false;
-                LOG_PRINTLN("Got valid configuration and connected to wifi.");
-                // delay(500);
-                // ESP.restart();
-            }
-        }
+        // Config mode ends once connected, or the access point comes back up
+        if (readDeviceConfigurationFromEeprom() && getWifiState() == WIFI_STATE_MDNS_UP)
+            setupWifi(false);
     }
 
+#ifdef ESP8266
+    // - logs (drained by their own task on ESP32)
+    drainLogs();
+#endif
+
+#ifdef ESP8266
+    // - jobs queued by the web server (run by their own task on ESP32)
+    runJobs();
+#endif
+
     // - wifi and server
     loopWiFi();
     loopServer();
 
-    // - ota software updates
+    // - ota software updates, checked by the jobs worker: on startup once connected, then every hour
     if (!configMode)
     {
+        if (!checkedForUpdateSinceBoot && getWifiState() == WIFI_STATE_MDNS_UP)
+            checkedForUpdateSinceBoot = enqueueJob("checkForUpdates", checkForUpdatesJob) != 0;
         updater->checkForSoftwareUpdate();
     }
 
     // Ram Stats
     updateMemoryStats();
 
+    // - telemetry for the /events clients
+    loopTelemetryEvents();
+
+    loopTimingEnd();
     if (bootLoopMode)
         return 2;
     if (configMode)
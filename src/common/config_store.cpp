@@ -0,0 +1,379 @@
+#include "common/config_store.h"
+
+#include <EEPROM.h>
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
+#include "common/crc32.h"
+#include "common/log.h"
+
+ConfigStore configStore;
+
+#ifdef ESP32
+#define CONFIG_LOG_PARTITION "cfglog"
+#define CONFIG_LOG_SECTOR_SIZE 4096
+
+const uint32_t configLogSectorMagic = 0x31474C43; // "CLG1"
+const uint16_t configLogRecordMagic = 0xC5A5;
+
+/*
+  Sector layout: LogSectorHeader, then records back to back (4-byte aligned) up to the end of
+  the sector. Erased flash reads 0xFF, so the first record with a wrong magic marks the end.
+  A record payload is a list of segments, each one a LogSegmentHeader followed by the bytes
+  to copy into the image at that address.
+*/
+struct LogSectorHeader
+{
+    uint32_t magic;
+    uint32_t seq;
+};
+
+struct LogRecordHeader
+{
+    uint16_t magic;
+    uint16_t length; // payload bytes, excluding padding
+    uint32_t seq;
+    uint32_t checksum;
+};
+
+struct LogSegmentHeader
+{
+    uint16_t address;
+    uint16_t length;
+};
+
+const size_t maxRecordPayload = CONFIG_STORE_MAX_DIRTY_RANGES * sizeof(LogSegmentHeader) + EEPROM_SIZE;
+
+uint8_t configImageBuffer[EEPROM_SIZE];
+uint8_t configRecordBuffer[sizeof(LogRecordHeader) + maxRecordPayload + 3];
+
+size_t recordSize(size_t payloadLength)
+{
+    return (sizeof(LogRecordHeader) + payloadLength + 3) & ~static_cast<size_t>(3);
+}
+
+uint32_t recordChecksum(const LogRecordHeader &header, const uint8_t *payload)
+{
+    uint32_t crc = calculateCrc32(&header, offsetof(LogRecordHeader, checksum));
+    return calculateCrc32(payload, header.length, crc);
+}
+#endif
+
+#ifdef ESP32
+static SemaphoreHandle_t configStoreMutex()
+{
+    static SemaphoreHandle_t mutex = xSemaphoreCreateRecursiveMutex();
+    return mutex;
+}
+
+void ConfigStore::lock()
+{
+    xSemaphoreTakeRecursive(configStoreMutex(), portMAX_DELAY);
+}
+
+void ConfigStore::unlock()
+{
+    xSemaphoreGiveRecursive(configStoreMutex());
+}
+#else
+void ConfigStore::lock() {}
+void ConfigStore::unlock() {}
+#endif
+
+bool ConfigStore::begin()
+{
+    ConfigStoreLock lock;
+    if (loaded)
+        return true;
+
+#ifdef ESP32
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_LOG_PARTITION);
+    if (partition != nullptr && partition->size >= 2 * CONFIG_LOG_SECTOR_SIZE)
+    {
+        loadFromLog();
+        loaded = true;
+        return true;
+    }
+    partition = nullptr;
+    LOG_W("cfglog", "no '" CONFIG_LOG_PARTITION "' partition found, storing configuration in EEPROM");
+#endif
+
+    if (!EEPROM.begin(EEPROM_SIZE))
+        return false;
+    image = EEPROM.getDataPtr();
+    loaded = true;
+    return true;
+}
+
+const uint8_t *ConfigStore::view(int address, size_t len)
+{
+    if (!begin() || address < 0 || address + len > EEPROM_SIZE)
+        return nullptr;
+    return image + address;
+}
+
+bool ConfigStore::stage(int address, const void *data, size_t len)
+{
+    ConfigStoreLock lock;
+    if (!begin() || address < 0 || address + len > EEPROM_SIZE)
+        return false;
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint8_t *target = image + address;
+    size_t i = 0;
+    while (i < len)
+    {
+        if (target[i] == bytes[i])
+        {
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < len && target[i] != bytes[i])
+            i++;
+        memcpy(target + start, bytes + start, i - start);
+        markDirty(address + start, i - start);
+        writeGeneration++;
+    }
+    return true;
+}
+
+bool ConfigStore::commit()
+{
+    ConfigStoreLock lock;
+    if (dirtyRangeCount == 0)
+        return true;
+
+    bool committed;
+#ifdef ESP32
+    if (partition != nullptr)
+        committed = appendRecord();
+    else
+#endif
+    {
+        // getDataPtr() flags the EEPROM buffer as dirty, so commit() actually writes it
+        EEPROM.getDataPtr();
+        committed = EEPROM.commit();
+    }
+    dirtyRangeCount = 0;
+    return committed;
+}
+
+void ConfigStore::markDirty(size_t address, size_t len)
+{
+    // Ranges are kept sorted. Close ranges are merged: a few unchanged bytes cost less
+    // than the header of an extra log segment.
+    const size_t mergeGap = 4;
+    size_t end = address + len;
+    uint8_t i = 0;
+    while (i < dirtyRangeCount && dirtyRanges[i].address + dirtyRanges[i].length + mergeGap < address)
+        i++;
+
+    uint8_t last = i;
+    while (last < dirtyRangeCount && dirtyRanges[last].address <= end + mergeGap)
+    {
+        address = min(address, (size_t)dirtyRanges[last].address);
+        end = max(end, (size_t)dirtyRanges[last].address + dirtyRanges[last].length);
+        last++;
+    }
+
+    if (last > i) // merged ranges i..last-1 into one
+    {
+        memmove(&dirtyRanges[i + 1], &dirtyRanges[last], (dirtyRangeCount - last) * sizeof(DirtyRange));
+        dirtyRangeCount -= last - i - 1;
+    }
+    else
+    {
+        if (dirtyRangeCount == CONFIG_STORE_MAX_DIRTY_RANGES)
+        {
+            // Out of slots: fold the new range into its nearest neighbour
+            if (i == dirtyRangeCount || (i > 0 && address - (dirtyRanges[i - 1].address + dirtyRanges[i - 1].length) < dirtyRanges[i].address - end))
+                i--;
+            address = min(address, (size_t)dirtyRanges[i].address);
+            end = max(end, (size_t)dirtyRanges[i].address + dirtyRanges[i].length);
+        }
+        else
+        {
+            memmove(&dirtyRanges[i + 1], &dirtyRanges[i], (dirtyRangeCount - i) * sizeof(DirtyRange));
+            dirtyRangeCount++;
+        }
+    }
+    dirtyRanges[i].address = address;
+    dirtyRanges[i].length = end - address;
+}
+
+#ifdef ESP32
+void ConfigStore::loadFromLog()
+{
+    sectorCount = partition->size / CONFIG_LOG_SECTOR_SIZE;
+    image = configImageBuffer;
+    memset(image, 0xFF, EEPROM_SIZE);
+
+    // The active sector is the valid one with the highest sequence number
+    bool found = false;
+    for (uint8_t sector = 0; sector < sectorCount; sector++)
+    {
+        LogSectorHeader header;
+        if (esp_partition_read(partition, sector * CONFIG_LOG_SECTOR_SIZE, &header, sizeof(header)) != ESP_OK)
+            continue;
+        if (header.magic != configLogSectorMagic || header.seq == 0xFFFFFFFF)
+            continue;
+        if (!found || header.seq > sectorSeq)
+        {
+            found = true;
+            activeSector = sector;
+            sectorSeq = header.seq;
+        }
+    }
+
+    if (found)
+    {
+        replayActiveSector();
+        LOG_D("cfglog", "sector %u seq %u, %u/%u bytes used", (unsigned)activeSector, (unsigned)sectorSeq, (unsigned)writeOffset, CONFIG_LOG_SECTOR_SIZE);
+        return;
+    }
+
+    // First boot with the log: carry over whatever the EEPROM held so existing configuration survives
+    LOG_PRINTLN(F("Config log: empty, importing EEPROM content"));
+    if (EEPROM.begin(EEPROM_SIZE))
+    {
+        memcpy(image, EEPROM.getDataPtr(), EEPROM_SIZE);
+        EEPROM.end();
+    }
+    activeSector = sectorCount - 1;
+    sectorSeq = 0;
+    compact();
+}
+
+void ConfigStore::replayActiveSector()
+{
+    const size_t sectorBase = activeSector * CONFIG_LOG_SECTOR_SIZE;
+    size_t offset = sizeof(LogSectorHeader);
+    recordSeq = 0;
+
+    while (offset + sizeof(LogRecordHeader) <= CONFIG_LOG_SECTOR_SIZE)
+    {
+        LogRecordHeader header;
+        if (esp_partition_read(partition, sectorBase + offset, &header, sizeof(header)) != ESP_OK)
+            break;
+        if (header.magic != configLogRecordMagic || header.length > maxRecordPayload ||
+            offset + recordSize(header.length) > CONFIG_LOG_SECTOR_SIZE)
+            break;
+
+        uint8_t *payload = configRecordBuffer + sizeof(LogRecordHeader);
+        if (esp_partition_read(partition, sectorBase + offset + sizeof(header), payload, header.length) != ESP_OK ||
+            recordChecksum(header, payload) != header.checksum)
+            break;
+
+        size_t position = 0;
+        while (position + sizeof(LogSegmentHeader) <= header.length)
+        {
+            LogSegmentHeader segment;
+            memcpy(&segment, payload + position, sizeof(segment));
+            position += sizeof(segment);
+            if (position + segment.length > header.length || segment.address + segment.length > EEPROM_SIZE)
+                break;
+            memcpy(image + segment.address, payload + position, segment.length);
+            position += segment.length;
+        }
+
+        recordSeq = header.seq;
+        offset += recordSize(header.length);
+    }
+    writeOffset = offset;
+
+    // A torn write leaves programmed bytes after the last valid record: never append on top of them
+    needsCompaction = false;
+    for (size_t checked = offset; checked < CONFIG_LOG_SECTOR_SIZE && !needsCompaction;)
+    {
+        size_t chunk = min(sizeof(configRecordBuffer), CONFIG_LOG_SECTOR_SIZE - checked);
+        if (esp_partition_read(partition, sectorBase + checked, configRecordBuffer, chunk) != ESP_OK)
+        {
+            needsCompaction = true;
+            break;
+        }
+        for (size_t i = 0; i < chunk; i++)
+        {
+            if (configRecordBuffer[i] != 0xFF)
+            {
+                needsCompaction = true;
+                break;
+            }
+        }
+        checked += chunk;
+    }
+}
+
+size_t ConfigStore::buildRecord(const DirtyRange *ranges, uint8_t count)
+{
+    LogRecordHeader header;
+    header.magic = configLogRecordMagic;
+    header.length = 0;
+    header.seq = ++recordSeq;
+
+    uint8_t *payload = configRecordBuffer + sizeof(LogRecordHeader);
+    for (uint8_t i = 0; i < count; i++)
+    {
+        LogSegmentHeader segment = {ranges[i].address, ranges[i].length};
+        memcpy(payload + header.length, &segment, sizeof(segment));
+        memcpy(payload + header.length + sizeof(segment), image + segment.address, segment.length);
+        header.length += sizeof(segment) + segment.length;
+    }
+
+    header.checksum = recordChecksum(header, payload);
+    memcpy(configRecordBuffer, &header, sizeof(header));
+
+    size_t size = recordSize(header.length);
+    memset(payload + header.length, 0xFF, size - sizeof(LogRecordHeader) - header.length);
+    return size;
+}
+
+bool ConfigStore::appendRecord()
+{
+    size_t payloadLength = 0;
+    for (uint8_t i = 0; i < dirtyRangeCount; i++)
+        payloadLength += sizeof(LogSegmentHeader) + dirtyRanges[i].length;
+
+    if (needsCompaction || writeOffset + recordSize(payloadLength) > CONFIG_LOG_SECTOR_SIZE)
+        return compact();
+
+    size_t size = buildRecord(dirtyRanges, dirtyRangeCount);
+    if (esp_partition_write(partition, activeSector * CONFIG_LOG_SECTOR_SIZE + writeOffset, configRecordBuffer, size) != ESP_OK)
+        return compact();
+
+    writeOffset += size;
+    return true;
+}
+
+bool ConfigStore::compact()
+{
+    const uint8_t nextSector = (activeSector + 1) % sectorCount;
+    const size_t sectorBase = nextSector * CONFIG_LOG_SECTOR_SIZE;
+
+    LOG_D("cfglog", "compacting into sector %u", (unsigned)nextSector);
+    if (esp_partition_erase_range(partition, sectorBase, CONFIG_LOG_SECTOR_SIZE) != ESP_OK)
+    {
+        needsCompaction = true;
+        return false;
+    }
+
+    // Snapshot first, sector header last: the sector becomes active only once the snapshot is complete
+    const DirtyRange wholeImage = {0, EEPROM_SIZE};
+    size_t size = buildRecord(&wholeImage, 1);
+    LogSectorHeader header = {configLogSectorMagic, sectorSeq + 1};
+    if (esp_partition_write(partition, sectorBase + sizeof(LogSectorHeader), configRecordBuffer, size) != ESP_OK ||
+        esp_partition_write(partition, sectorBase, &header, sizeof(header)) != ESP_OK)
+    {
+        needsCompaction = true;
+        return false;
+    }
+
+    activeSector = nextSector;
+    sectorSeq = header.seq;
+    writeOffset = sizeof(LogSectorHeader) + size;
+    needsCompaction = false;
+    return true;
+}
+#endif
@@ -0,0 +1,91 @@
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <Arduino.h>
+
+#ifdef ESP32
+#include <esp_partition.h>
+#endif
+
+#ifndef EEPROM_SIZE
+#define EEPROM_SIZE 512
+#endif
+
+#define CONFIG_STORE_MAX_DIRTY_RANGES 8
+
+/**
+ * Persistent byte image of EEPROM_SIZE bytes, addressed like the EEPROM.
+ *
+ * On ESP32, when the partition table has a "cfglog" data partition, every write is
+ * appended as a small checksummed record to a log spread over the partition's sectors.
+ * When the active sector is full, the whole image is compacted into the next sector, so
+ * erases rotate evenly through all of them instead of hitting the same sector on every write.
+ * Without that partition (and on ESP8266), the image is backed by the EEPROM library.
+ *
+ * The image is loaded once and stays resident: view() hands out pointers into it, and
+ * generation() changes whenever its content changes so callers can cache what they validated.
+ *
+ * stage() copies data into the image and only records the byte ranges that actually changed;
+ * commit() persists all of them at once (a single log record, or a single EEPROM commit) and
+ * does nothing when no byte changed.
+ *
+ * The store is written from async_tcp (configuration routes) and from the loop task (quick
+ * restarts): begin(), stage() and commit() take a recursive lock, and callers hold a
+ * ConfigStoreLock around anything that must not interleave with another task's writes
+ * (a transaction's stage()s and commit(), or validating a view).
+ */
+class ConfigStore
+{
+public:
+    struct DirtyRange
+    {
+        uint16_t address;
+        uint16_t length;
+    };
+
+    bool begin();
+    void lock();
+    void unlock();
+    const uint8_t *view(int address, size_t len);
+    bool stage(int address, const void *data, size_t len);
+    bool commit();
+    uint32_t generation() const { return writeGeneration; }
+
+private:
+    bool loaded = false;
+    uint8_t *image = nullptr;
+    uint32_t writeGeneration = 1;
+    DirtyRange dirtyRanges[CONFIG_STORE_MAX_DIRTY_RANGES];
+    uint8_t dirtyRangeCount = 0;
+
+    void markDirty(size_t address, size_t len);
+
+#ifdef ESP32
+    const esp_partition_t *partition = nullptr;
+    uint8_t sectorCount = 0;
+    uint8_t activeSector = 0;
+    uint32_t sectorSeq = 0;
+    uint32_t recordSeq = 0;
+    size_t writeOffset = 0;
+    bool needsCompaction = false;
+
+    void loadFromLog();
+    void replayActiveSector();
+    size_t buildRecord(const DirtyRange *ranges, uint8_t count);
+    bool appendRecord();
+    bool compact();
+#endif
+};
+
+extern ConfigStore configStore;
+
+class ConfigStoreLock
+{
+public:
+    ConfigStoreLock() { configStore.lock(); }
+    ~ConfigStoreLock() { configStore.unlock(); }
+    ConfigStoreLock(const ConfigStoreLock &) = delete;
+    ConfigStoreLock &operator=(const ConfigStoreLock &) = delete;
+};
+
+#endif // CONFIG_STORE_H
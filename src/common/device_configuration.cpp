@@ -1,11 +1,9 @@
 #include "common/device_configuration.h"
 #include "common/eeprom_utils.tpp"
 #include "common/globals.h"
+#include "common/response_cache.h"
 
-int JUST_RESTARTED_EEPROM_ADDR;
-int DEVICE_CONFIGURATION_EEPROM_ADDR;
-
-DeviceConfiguration *currentDeviceConfiguration = nullptr;
+const DeviceConfiguration *currentDeviceConfiguration = nullptr;
 
 void DeviceConfiguration::printToSerial()
 {
@@ -16,25 +14,25 @@ void DeviceConfiguration::printToSerial()
 bool readDeviceConfigurationFromEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: device configuration: read"));
-    DeviceConfiguration *eepromConfig = readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR);
+    const DeviceConfiguration *eepromConfig = readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR);
     if (eepromConfig != nullptr)
     {
         currentDeviceConfiguration = eepromConfig;
+        bumpStateVersion();
         DEBUG_PRINTLN(currentDeviceConfiguration->toStr());
         return true;
     }
-    LOG_PRINTLN(F(">>WARNING: got invalid DeviceConfiguration info from EEPROM"));
+    LOG_W("eeprom", "got invalid DeviceConfiguration info from EEPROM");
     return false;
 }
 
-void saveDeviceConfigurationToEeprom()
+void saveDeviceConfigurationToEeprom(const DeviceConfiguration &config)
 {
     DEBUG_PRINTLN(F("EEPROM: device configuration: write"));
-    DEBUG_PRINTLN(currentDeviceConfiguration->toStr());
-    if (currentDeviceConfiguration == nullptr)
-        return;
+    DEBUG_PRINTLN(config.toStr());
 
-    writeDataToEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR, currentDeviceConfiguration);
+    writeDataToEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR, &config);
+    readDeviceConfigurationFromEeprom();
     DEBUG_PRINTLN(F("Done writing to EEPROM"));
 }
 
@@ -47,10 +45,10 @@ void invalidateDeviceConfigurationOnEeprom()
 uint8_t readQuickRestartsFromEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: just restarted: read...: "));
-    QuickRestarts *eepromConfig = readDataFromEeprom<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR);
+    const QuickRestarts *eepromConfig = readDataFromEeprom<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR);
     if (eepromConfig == nullptr)
     {
-        LOG_PRINTLN(F(">>WARNING: got invalid quickRestart info from EEPROM"));
+        LOG_W("eeprom", "got invalid quickRestart info from EEPROM");
         return 255;
     }
     DEBUG_PRINTLN(eepromConfig->consecutiveQuickRestartsCount == 0 ? "Not a quick restart!" : String(eepromConfig->consecutiveQuickRestartsCount));
@@ -61,7 +59,7 @@ void saveQuickRestartsToEeprom(bool isQuickRestart)
 {
     uint8_t restartsCount = !isQuickRestart ? 0 : readQuickRestartsFromEeprom() + 1;
 
-    DEBUG_PRINTLN("EEPROM: just restarted: write: count: " + String(restartsCount));
+    LOG_D("eeprom", "just restarted: write: count: %u", restartsCount);
     QuickRestarts qr(restartsCount);
     writeDataToEeprom<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR, &qr);
     DEBUG_PRINTLN(F(" ..done"));
@@ -14,10 +14,16 @@
 #pragma pack(push, 1)
 
 /**
- * These structs are stored in the EEPROM
+ * These structs are stored in the EEPROM.
+ * Bump SCHEMA_VERSION whenever the fields of a struct change, and register an upgrade
+ * from the previous version (see registerEepromUpgrade): older records are migrated at boot.
+ * EEPROM_CAPACITY reserves room for the struct to grow without moving the following ones.
  */
 struct QuickRestarts
 {
+  static constexpr uint16_t SCHEMA_VERSION = 1;
+  static constexpr uint16_t EEPROM_CAPACITY = 8;
+
   uint8_t consecutiveQuickRestartsCount;
 
   // needed to allocate space when reading from eeprom for permanent configuration
@@ -31,6 +37,9 @@ struct QuickRestarts
 
 struct DeviceConfiguration
 {
+  static constexpr uint16_t SCHEMA_VERSION = 1;
+  static constexpr uint16_t EEPROM_CAPACITY = 256;
+
   char ssid[30];
   char password[24];
   char hostname[20];
@@ -70,8 +79,10 @@ struct DeviceConfiguration
 
 #pragma pack(pop)
 
+void migrateCommonDataOnEeprom();
+
 bool readDeviceConfigurationFromEeprom();
-void saveDeviceConfigurationToEeprom();
+void saveDeviceConfigurationToEeprom(const DeviceConfiguration &config);
 void invalidateDeviceConfigurationOnEeprom();
 
 uint8_t readQuickRestartsFromEeprom();
@@ -0,0 +1,128 @@
+#ifndef EEPROM_LAYOUT_H
+#define EEPROM_LAYOUT_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+#include "common/config_store.h"
+#include "common/device_configuration.h"
+
+#define EEPROM_RECORD_MAGIC 0xE5C0
+
+/**
+ * Stored in front of every struct in the EEPROM.
+ * schemaVersion and length identify the struct layout that produced the bytes,
+ * crc covers the fields above it and the struct data.
+ */
+#pragma pack(push, 1)
+struct EepromRecordHeader
+{
+    uint16_t magic;
+    uint16_t schemaVersion;
+    uint16_t length;
+    uint32_t crc;
+};
+#pragma pack(pop)
+
+/**
+ * Bytes reserved for a struct: sizeof(T), or T::EEPROM_CAPACITY when the struct declares it.
+ * Reserving room lets a struct grow in a later schema version without moving the slots after it,
+ * so its old record can be migrated in place.
+ */
+template <typename T, typename = void>
+struct EepromSlotCapacity
+{
+    static constexpr size_t value = sizeof(T);
+};
+
+template <typename T>
+struct EepromSlotCapacity<T, decltype(void(T::EEPROM_CAPACITY))>
+{
+    static_assert(T::EEPROM_CAPACITY >= sizeof(T), "EEPROM_CAPACITY is smaller than the struct");
+    static constexpr size_t value = T::EEPROM_CAPACITY;
+};
+
+template <typename T>
+struct EepromSlot
+{
+    static constexpr size_t size = sizeof(EepromRecordHeader) + EepromSlotCapacity<T>::value;
+};
+
+template <typename T, typename... Ts>
+struct EepromSlotOffset; // T is not part of the layout
+
+template <typename T, typename... Tail>
+struct EepromSlotOffset<T, T, Tail...>
+{
+    static constexpr size_t value = 0;
+};
+
+template <typename T, typename Head, typename... Tail>
+struct EepromSlotOffset<T, Head, Tail...>
+{
+    static constexpr size_t value = EepromSlot<Head>::size + EepromSlotOffset<T, Tail...>::value;
+};
+
+template <typename T, typename... Ts>
+struct EepromSlotCount;
+
+template <typename T>
+struct EepromSlotCount<T>
+{
+    static constexpr size_t value = 0;
+};
+
+template <typename T, typename Head, typename... Tail>
+struct EepromSlotCount<T, Head, Tail...>
+{
+    static constexpr size_t value = (std::is_same<T, Head>::value ? 1 : 0) + EepromSlotCount<T, Tail...>::value;
+};
+
+template <typename... Ts>
+struct EepromSlotsSize;
+
+template <>
+struct EepromSlotsSize<>
+{
+    static constexpr size_t value = 0;
+};
+
+template <typename Head, typename... Tail>
+struct EepromSlotsSize<Head, Tail...>
+{
+    static constexpr size_t value = EepromSlot<Head>::size + EepromSlotsSize<Tail...>::value;
+};
+
+/**
+ * EEPROM layout of the stored structs, resolved at compile time.
+ * Slots are placed back to back in the order of Ts, each one a record header followed by the
+ * struct's capacity.
+ * Asking for the address of a struct that is not part of the layout fails to compile.
+ */
+template <typename... Ts>
+struct EepromLayout
+{
+    static constexpr size_t size = EepromSlotsSize<Ts...>::value;
+    static_assert(size <= EEPROM_SIZE, "EEPROM layout doesn't fit in EEPROM_SIZE");
+
+    template <typename... Us>
+    using Append = EepromLayout<Ts..., Us...>;
+
+    template <typename T>
+    static constexpr int address()
+    {
+        static_assert(EepromSlotCount<T, Ts...>::value == 1, "Each struct must appear exactly once in the EEPROM layout");
+        return EepromSlotOffset<T, Ts...>::value;
+    }
+};
+
+/**
+ * Structs used by the common code. They always come first:
+ * projects add their own structs with CommonEepromLayout::Append<...>.
+ */
+using CommonEepromLayout = EepromLayout<QuickRestarts, DeviceConfiguration>;
+
+constexpr int JUST_RESTARTED_EEPROM_ADDR = CommonEepromLayout::address<QuickRestarts>();
+constexpr int DEVICE_CONFIGURATION_EEPROM_ADDR = CommonEepromLayout::address<DeviceConfiguration>();
+
+#endif // EEPROM_LAYOUT_H
@@ -0,0 +1,53 @@
+#include "common/device_configuration.h"
+#include "common/eeprom_utils.tpp"
+#include "common/log.h"
+
+/**
+ * Before record headers existed, structs were stored behind a byte-sum checksum, with QuickRestarts
+ * at address 0 and DeviceConfiguration right after it. Carry those over as schema version 1
+ * records, so the OTA update introducing the new layout doesn't send devices back to config mode.
+ */
+static void importLegacyEepromData()
+{
+    const int legacyQuickRestartsAddr = 0;
+    const uint16_t legacyQuickRestartsSize = 1;
+    const int legacyDeviceConfigurationAddr = legacyQuickRestartsAddr + sizeof(uint32_t) + legacyQuickRestartsSize;
+    const uint16_t legacyDeviceConfigurationSize = 194;
+
+    // QuickRestarts is written on every boot: once it has a record header, there is nothing left to import
+    const uint8_t *firstRecord = configStore.view(JUST_RESTARTED_EEPROM_ADDR, sizeof(EepromRecordHeader));
+    if (firstRecord == nullptr || reinterpret_cast<const EepromRecordHeader *>(firstRecord)->magic == EEPROM_RECORD_MAGIC)
+        return;
+
+    // copy both structs out first: the new slots overlap the legacy ones
+    uint8_t quickRestarts[legacyQuickRestartsSize];
+    uint8_t deviceConfiguration[legacyDeviceConfigurationSize];
+    uint32_t quickRestartsChecksum, deviceConfigurationChecksum;
+    memcpy(&quickRestartsChecksum, configStore.view(legacyQuickRestartsAddr, sizeof(uint32_t)), sizeof(uint32_t));
+    memcpy(quickRestarts, configStore.view(legacyQuickRestartsAddr + sizeof(uint32_t), legacyQuickRestartsSize), legacyQuickRestartsSize);
+    memcpy(&deviceConfigurationChecksum, configStore.view(legacyDeviceConfigurationAddr, sizeof(uint32_t)), sizeof(uint32_t));
+    memcpy(deviceConfiguration, configStore.view(legacyDeviceConfigurationAddr + sizeof(uint32_t), legacyDeviceConfigurationSize), legacyDeviceConfigurationSize);
+
+    uint32_t checksum = 0;
+    for (uint8_t byte : deviceConfiguration)
+        checksum += byte;
+    // an all-zero EEPROM passes the byte-sum check
+    if (checksum != deviceConfigurationChecksum || checksum == 0)
+        return;
+
+    LOG_PRINTLN(F("EEPROM: importing configuration stored by a previous firmware"));
+    EepromTransaction transaction;
+    transaction.writeRecord(DEVICE_CONFIGURATION_EEPROM_ADDR, 1, deviceConfiguration, legacyDeviceConfigurationSize);
+    if (quickRestarts[0] == quickRestartsChecksum)
+        transaction.writeRecord(JUST_RESTARTED_EEPROM_ADDR, 1, quickRestarts, legacyQuickRestartsSize);
+    else
+        transaction.invalidate(JUST_RESTARTED_EEPROM_ADDR);
+    transaction.commit();
+}
+
+void migrateCommonDataOnEeprom()
+{
+    importLegacyEepromData();
+    migrateEepromData<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR);
+    migrateEepromData<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR);
+}
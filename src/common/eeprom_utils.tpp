@@ -1,83 +1,220 @@
 #ifndef EEPROM_UTILS_TPP
 #define EEPROM_UTILS_TPP
 
-#include <EEPROM.h>
 #include <Arduino.h>
 
-#include "common/globals.h"
+#include "common/config_store.h"
+#include "common/crc32.h"
+#include "common/eeprom_layout.h"
+#include "common/log.h"
 
-#ifndef EEPROM_SIZE
-#define EEPROM_SIZE 512
-#endif
-
-using checksum_type = uint32_t;
+inline uint32_t calculateRecordCrc(const EepromRecordHeader &header, const void *data)
+{
+    uint32_t crc = calculateCrc32(&header, offsetof(EepromRecordHeader, crc));
+    return calculateCrc32(data, header.length, crc);
+}
 
+/**
+ * Returns a view of the struct stored at eepromAddress, or nullptr if its record is not valid
+ * for the current layout of T (magic, T::SCHEMA_VERSION, sizeof(T) and CRC must all match).
+ * The view points into the resident store image: nothing is allocated, and the record is
+ * only validated again after the store has been written.
+ */
 template <typename T>
-T *readDataFromEeprom(const int eepromAddress)
+const T *readDataFromEeprom(const int eepromAddress)
 {
-    DEBUG_PRINTLN(String("Reading from EEPROM address ") + String(eepromAddress));
-    EEPROM.begin(EEPROM_SIZE);
-
-    // read checksum first, then data
-    checksum_type expectedChecksum;
-    EEPROM.get(eepromAddress, expectedChecksum);
+    static_assert(alignof(T) == 1, "Structs stored in the EEPROM must be packed, see device_configuration.h");
+    ConfigStoreLock lock; // for the cache, and so that no write lands while the record is validated
+
+    static int cachedAddress = -1;
+    static uint32_t cachedGeneration = 0;
+    static const T *cachedData = nullptr;
+    if (cachedAddress == eepromAddress && cachedGeneration == configStore.generation())
+        return cachedData;
+
+    LOG_D("eeprom", "Reading from EEPROM address %d", eepromAddress);
+    const uint8_t *slot = configStore.view(eepromAddress, sizeof(EepromRecordHeader) + sizeof(T));
+    if (slot == nullptr)
+        return nullptr;
 
-    T *data = new T();
-    EEPROM.get(eepromAddress + sizeof(checksum_type), *data);
-    EEPROM.end();
+    // read header first, then data
+    EepromRecordHeader header;
+    memcpy(&header, slot, sizeof(EepromRecordHeader));
+    const T *data = reinterpret_cast<const T *>(slot + sizeof(EepromRecordHeader));
 
-    checksum_type checksum = calculateChecksum(data);
+    bool valid = header.magic == EEPROM_RECORD_MAGIC &&
+                 header.schemaVersion == T::SCHEMA_VERSION &&
+                 header.length == sizeof(T) &&
+                 header.crc == calculateRecordCrc(header, data);
 
-    if (checksum == expectedChecksum)
-        return data;
-    else
-        return nullptr;
+    cachedAddress = eepromAddress;
+    cachedGeneration = configStore.generation();
+    cachedData = valid ? data : nullptr;
+    return cachedData;
 }
 
-template <typename T>
-void writeDataToEeprom(int eepromAddress, T *data)
+/**
+ * Groups writes to several stored structs into a single store commit.
+ * Only the bytes that differ from what is stored are written, and commit()
+ * doesn't touch the flash at all when nothing changed.
+ *
+ *   EepromTransaction transaction;
+ *   transaction.write(DEVICE_CONFIGURATION_EEPROM_ADDR, &config);
+ *   transaction.write(JUST_RESTARTED_EEPROM_ADDR, &quickRestarts);
+ *   transaction.commit();
+ *
+ * Staged data is visible to readDataFromEeprom right away; it is persisted on commit().
+ * The store is locked for the transaction's lifetime, so other tasks never see half of it.
+ */
+class EepromTransaction
 {
-    DEBUG_PRINTLN(String("Writing to EEPROM address ") + String(eepromAddress));
-    EEPROM.begin(EEPROM_SIZE);
+public:
+    template <typename T>
+    void write(int eepromAddress, const T *data)
+    {
+        writeRecord(eepromAddress, T::SCHEMA_VERSION, data, sizeof(T));
+    }
+
+    void writeRecord(int eepromAddress, uint16_t schemaVersion, const void *data, uint16_t length)
+    {
+        LOG_D("eeprom", "Writing to EEPROM address %d", eepromAddress);
+
+        EepromRecordHeader header;
+        header.magic = EEPROM_RECORD_MAGIC;
+        header.schemaVersion = schemaVersion;
+        header.length = length;
+        header.crc = calculateRecordCrc(header, data);
+
+        configStore.stage(eepromAddress, &header, sizeof(EepromRecordHeader));
+        configStore.stage(eepromAddress + sizeof(EepromRecordHeader), data, length);
+    }
+
+    void invalidate(int eepromAddress)
+    {
+        EepromRecordHeader empty = {};
+        configStore.stage(eepromAddress, &empty, sizeof(EepromRecordHeader));
+    }
+
+    bool commit()
+    {
+        return configStore.commit();
+    }
+
+private:
+    ConfigStoreLock lock;
+};
 
-    checksum_type checksum = calculateChecksum(data);
-    EEPROM.put(eepromAddress, checksum);
-    EEPROM.put(eepromAddress + sizeof(checksum_type), *data);
-
-    EEPROM.commit();
-    EEPROM.end();
+template <typename T>
+void writeDataToEeprom(int eepromAddress, const T *data)
+{
+    EepromTransaction transaction;
+    transaction.write(eepromAddress, data);
+    transaction.commit();
 }
 
 template <typename T>
-checksum_type calculateChecksum(const T *data)
+void invalidateEepromData(const int eepromAddress)
 {
-    checksum_type checksum = 0;
-    const uint8_t *ptr = reinterpret_cast<const uint8_t *>(data);
-    for (size_t i = 0; i < sizeof(T); i++)
-        checksum += *ptr++;
-
-    return checksum;
+    EepromTransaction transaction;
+    transaction.invalidate(eepromAddress);
+    transaction.commit();
 }
 
+/**
+ * Upgrades the data of a stored struct from one schema version to the next.
+ * Reads oldLength bytes from oldData, writes the upgraded struct to newData
+ * (at most EEPROM_SIZE bytes) and returns its length, or 0 if the data can't be upgraded.
+ */
+typedef size_t (*EepromUpgradeFunction)(const uint8_t *oldData, size_t oldLength, uint8_t *newData);
+
 template <typename T>
-void invalidateEepromData(const int eepromAddress)
+EepromUpgradeFunction *eepromUpgrades()
 {
-    EEPROM.begin(EEPROM_SIZE);
+    // upgrades[v] turns version v into version v + 1
+    static EepromUpgradeFunction upgrades[T::SCHEMA_VERSION] = {};
+    return upgrades;
+}
 
-    checksum_type empty = 0;
-    EEPROM.put(eepromAddress, empty);
-    EEPROM.commit();
-    EEPROM.end();
+/**
+ * Registers the upgrade of T from fromVersion to fromVersion + 1. For instance, after adding a field:
+ *
+ *   size_t upgradeDeviceConfigurationV1(const uint8_t *oldData, size_t oldLength, uint8_t *newData)
+ *   {
+ *       DeviceConfiguration config;
+ *       memcpy(&config, oldData, sizeof(DeviceConfigurationV1));
+ *       config.newField = defaultValue;
+ *       memcpy(newData, &config, sizeof(config));
+ *       return sizeof(config);
+ *   }
+ *   registerEepromUpgrade<DeviceConfiguration>(1, upgradeDeviceConfigurationV1);
+ */
+template <typename T>
+void registerEepromUpgrade(uint16_t fromVersion, EepromUpgradeFunction upgrade)
+{
+    if (fromVersion < T::SCHEMA_VERSION)
+        eepromUpgrades<T>()[fromVersion] = upgrade;
 }
 
+/**
+ * Brings the record at eepromAddress to the current T::SCHEMA_VERSION by running the registered
+ * upgrades in sequence, then rewrites it in place. Meant to run once at boot, before the first read.
+ * Returns true if the record was migrated.
+ */
 template <typename T>
-int nextEepromSlot(int previousSlotStartAddress)
+bool migrateEepromData(const int eepromAddress)
 {
-    // checksum + size of previous struct:
-    int address = sizeof(T) + sizeof(checksum_type);
-    // add offset:
-    address += previousSlotStartAddress;
-    return address;
+    const uint8_t *slot = configStore.view(eepromAddress, sizeof(EepromRecordHeader) + EepromSlotCapacity<T>::value);
+    if (slot == nullptr)
+        return false;
+
+    EepromRecordHeader header;
+    memcpy(&header, slot, sizeof(EepromRecordHeader));
+    if (header.magic != EEPROM_RECORD_MAGIC || header.schemaVersion == T::SCHEMA_VERSION)
+        return false;
+
+    const uint8_t *data = slot + sizeof(EepromRecordHeader);
+    if (header.length > EepromSlotCapacity<T>::value ||
+        header.crc != calculateRecordCrc(header, data))
+    {
+        LOG_E("eeprom", "record at %d is corrupted, can't migrate it", eepromAddress);
+        return false;
+    }
+    if (header.schemaVersion > T::SCHEMA_VERSION)
+    {
+        LOG_W("eeprom", "record at %d has newer schema version %u", eepromAddress, header.schemaVersion);
+        return false;
+    }
+
+    uint8_t buffers[2][EEPROM_SIZE];
+    uint8_t current = 0;
+    size_t length = header.length;
+    memcpy(buffers[current], data, length);
+
+    for (uint16_t version = header.schemaVersion; version < T::SCHEMA_VERSION; version++)
+    {
+        EepromUpgradeFunction upgrade = eepromUpgrades<T>()[version];
+        if (upgrade == nullptr)
+        {
+            LOG_E("eeprom", "no upgrade registered from schema version %u at %d", version, eepromAddress);
+            return false;
+        }
+        length = upgrade(buffers[current], length, buffers[1 - current]);
+        current = 1 - current;
+        if (length == 0)
+        {
+            LOG_E("eeprom", "upgrade from schema version %u failed at %d", version, eepromAddress);
+            return false;
+        }
+    }
+    if (length != sizeof(T))
+    {
+        LOG_E("eeprom", "upgraded record at %d has the wrong size", eepromAddress);
+        return false;
+    }
+
+    LOG_I("eeprom", "migrated record at %d from schema version %u to %u", eepromAddress, header.schemaVersion, T::SCHEMA_VERSION);
+    writeDataToEeprom(eepromAddress, reinterpret_cast<const T *>(buffers[current]));
+    return true;
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -4,6 +4,8 @@
 #include <ESP8266WebServer.h>
 #include <Updater.h>
 
+#include "common/globals.h"
+
 ESP8266WebServer otaServer(8888);
 
 void setupEsp8266OtaUpdate() {
@@ -21,19 +23,19 @@ void setupEsp8266OtaUpdate() {
     }, []() {
         HTTPUpload& upload = otaServer.upload();
         if (upload.status == UPLOAD_FILE_START) {
-            Serial.printf("Update Start: %s\n", upload.filename.c_str());
+            LOG_I("ota", "Update Start: %s", upload.filename.c_str());
             if (!Update.begin(ESP.getFreeSketchSpace())) {
-                Update.printError(Serial);
+                LOG_E("ota", "Update failed at start: %s", Update.getErrorString().c_str());
             }
         } else if (upload.status == UPLOAD_FILE_WRITE) {
             if (Update.write(upload.buf, upload.currentSize) != upload.currentSize) {
-                Update.printError(Serial);
+                LOG_E("ota", "Update failed during write: %s", Update.getErrorString().c_str());
             }
         } else if (upload.status == UPLOAD_FILE_END) {
             if (Update.end(true)) {
-                Serial.printf("Update Success: %u\nRebooting...\n", upload.totalSize);
+                LOG_I("ota", "Update Success: %u, rebooting...", (unsigned)upload.totalSize);
             } else {
-                Update.printError(Serial);
+                LOG_E("ota", "Update failed at end: %s", Update.getErrorString().c_str());
             }
         }
         yield(); // Keep the watchdog timer happy
@@ -0,0 +1,262 @@
+#include "common/heap_trace.h"
+
+#if defined(HEAP_TRACE) && defined(ESP32)
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// The table holds 1 << HEAP_TRACE_TABLE_BITS entries, and is never filled above 3/4
+#ifndef HEAP_TRACE_TABLE_BITS
+#define HEAP_TRACE_TABLE_BITS 10
+#endif
+#define HEAP_TRACE_TABLE_SIZE (1 << HEAP_TRACE_TABLE_BITS)
+#define HEAP_TRACE_MAX_TASKS 16 // tasks inside a HeapTraceScope at once
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_calloc(size_t count, size_t size);
+extern "C" void *__real_realloc(void *ptr, size_t size);
+extern "C" void __real_free(void *ptr);
+
+struct LiveAllocation
+{
+    void *ptr; // nullptr: empty entry
+    uint32_t size : 24;
+    uint32_t scope : 8;
+};
+
+// A task inside a HeapTraceScope, other tasks are in the scope picked from their name
+struct TaskScope
+{
+    TaskHandle_t task; // nullptr: empty entry
+    HeapScope scope;
+    uint8_t depth; // nested HeapTraceScopes, the entry is freed when the last one ends
+};
+
+static portMUX_TYPE heapTraceLock = portMUX_INITIALIZER_UNLOCKED;
+static LiveAllocation liveAllocations[HEAP_TRACE_TABLE_SIZE];
+static size_t liveAllocationCount = 0;
+static uint32_t untrackedAllocations = 0;
+static TaskScope taskScopes[HEAP_TRACE_MAX_TASKS];
+static HeapScopeStats scopeStats[HEAP_SCOPE_COUNT];
+
+static const char *const scopeNames[HEAP_SCOPE_COUNT] = {"other", "app", "wifi", "web_server", "ota", "logging"};
+
+static size_t slotOf(const void *ptr)
+{
+    return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(ptr) * 2654435761u) >> (32 - HEAP_TRACE_TABLE_BITS);
+}
+
+static HeapScope defaultScope(TaskHandle_t task)
+{
+    const char *name = pcTaskGetTaskName(task);
+    if (strcmp(name, "loopTask") == 0)
+        return HEAP_SCOPE_APP;
+    if (strcmp(name, "async_tcp") == 0)
+        return HEAP_SCOPE_WEB_SERVER;
+    if (strcmp(name, "log_drain") == 0)
+        return HEAP_SCOPE_LOGGING;
+    if (strcmp(name, "wifi") == 0 || strcmp(name, "tiT") == 0 || strcmp(name, "sys_evt") == 0 || strcmp(name, "arduino_events") == 0)
+        return HEAP_SCOPE_WIFI;
+    return HEAP_SCOPE_OTHER;
+}
+
+// The entry of the current task, or a new one if create. Must be called with heapTraceLock held
+static TaskScope *findTaskScope(bool create)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (task == nullptr)
+        return nullptr;
+    TaskScope *empty = nullptr;
+    for (size_t i = 0; i < HEAP_TRACE_MAX_TASKS; i++)
+    {
+        if (taskScopes[i].task == task)
+            return &taskScopes[i];
+        if (taskScopes[i].task == nullptr && empty == nullptr)
+            empty = &taskScopes[i];
+    }
+    if (!create || empty == nullptr)
+        return nullptr;
+    *empty = {task, defaultScope(task), 0};
+    return empty;
+}
+
+// Must be called with heapTraceLock held
+static HeapScope currentScope()
+{
+    TaskScope *taskScope = findTaskScope(false);
+    if (taskScope != nullptr)
+        return taskScope->scope;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    return task != nullptr ? defaultScope(task) : HEAP_SCOPE_OTHER;
+}
+
+// Must be called with heapTraceLock held
+static void insertAllocation(const LiveAllocation &allocation)
+{
+    if (liveAllocationCount >= HEAP_TRACE_TABLE_SIZE * 3 / 4)
+    {
+        untrackedAllocations++;
+        return;
+    }
+    size_t slot = slotOf(allocation.ptr);
+    while (liveAllocations[slot].ptr != nullptr)
+        slot = (slot + 1) % HEAP_TRACE_TABLE_SIZE;
+    liveAllocations[slot] = allocation;
+    liveAllocationCount++;
+
+    HeapScopeStats &stats = scopeStats[allocation.scope];
+    stats.liveBytes += allocation.size;
+    if (stats.liveBytes > stats.peakBytes)
+        stats.peakBytes = stats.liveBytes;
+}
+
+// Removes and returns the entry of ptr, whose ptr is nullptr if it wasn't tracked (allocated while
+// the table was full, or before tracing could see it). Must be called with heapTraceLock held
+static LiveAllocation removeAllocation(void *ptr)
+{
+    size_t slot = slotOf(ptr);
+    while (liveAllocations[slot].ptr != nullptr && liveAllocations[slot].ptr != ptr)
+        slot = (slot + 1) % HEAP_TRACE_TABLE_SIZE;
+    LiveAllocation removed = liveAllocations[slot];
+    if (removed.ptr == nullptr)
+        return removed;
+
+    scopeStats[removed.scope].liveBytes -= removed.size;
+    liveAllocationCount--;
+
+    // Linear probing removal: shift back the following entries that probed past this slot
+    size_t next = slot;
+    while (true)
+    {
+        next = (next + 1) % HEAP_TRACE_TABLE_SIZE;
+        if (liveAllocations[next].ptr == nullptr)
+            break;
+        size_t home = slotOf(liveAllocations[next].ptr);
+        bool movable = slot <= next ? (home <= slot || home > next) : (home <= slot && home > next);
+        if (movable)
+        {
+            liveAllocations[slot] = liveAllocations[next];
+            slot = next;
+        }
+    }
+    liveAllocations[slot].ptr = nullptr;
+    return removed;
+}
+
+static void traceAllocation(void *ptr, size_t size)
+{
+    portENTER_CRITICAL(&heapTraceLock);
+    LiveAllocation allocation = {ptr, static_cast<uint32_t>(size), currentScope()};
+    scopeStats[allocation.scope].allocations++;
+    insertAllocation(allocation);
+    portEXIT_CRITICAL(&heapTraceLock);
+}
+
+static void traceFree(void *ptr)
+{
+    portENTER_CRITICAL(&heapTraceLock);
+    LiveAllocation removed = removeAllocation(ptr);
+    if (removed.ptr != nullptr)
+        scopeStats[removed.scope].frees++;
+    portEXIT_CRITICAL(&heapTraceLock);
+}
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    void *ptr = __real_malloc(size);
+    if (ptr != nullptr)
+        traceAllocation(ptr, size);
+    return ptr;
+}
+
+extern "C" void *__wrap_calloc(size_t count, size_t size)
+{
+    void *ptr = __real_calloc(count, size);
+    if (ptr != nullptr)
+        traceAllocation(ptr, count * size);
+    return ptr;
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size)
+{
+    // untrack first: once the block is released, another task may get the same address
+    LiveAllocation old = {};
+    if (ptr != nullptr)
+    {
+        portENTER_CRITICAL(&heapTraceLock);
+        old = removeAllocation(ptr);
+        portEXIT_CRITICAL(&heapTraceLock);
+    }
+    void *newPtr = __real_realloc(ptr, size);
+    if (newPtr != nullptr)
+    {
+        if (old.ptr != nullptr)
+        {
+            portENTER_CRITICAL(&heapTraceLock);
+            scopeStats[old.scope].frees++;
+            portEXIT_CRITICAL(&heapTraceLock);
+        }
+        traceAllocation(newPtr, size);
+    }
+    else if (old.ptr != nullptr && size > 0)
+    {
+        // failed: the old block is still there, as it was
+        portENTER_CRITICAL(&heapTraceLock);
+        insertAllocation(old);
+        portEXIT_CRITICAL(&heapTraceLock);
+    }
+    return newPtr;
+}
+
+extern "C" void __wrap_free(void *ptr)
+{
+    if (ptr != nullptr)
+        traceFree(ptr);
+    __real_free(ptr);
+}
+
+HeapTraceScope::HeapTraceScope(HeapScope scope)
+{
+    portENTER_CRITICAL(&heapTraceLock);
+    TaskScope *taskScope = findTaskScope(true);
+    previous = taskScope ? taskScope->scope : HEAP_SCOPE_OTHER;
+    if (taskScope)
+    {
+        taskScope->scope = scope;
+        taskScope->depth++;
+    }
+    portEXIT_CRITICAL(&heapTraceLock);
+}
+
+HeapTraceScope::~HeapTraceScope()
+{
+    portENTER_CRITICAL(&heapTraceLock);
+    TaskScope *taskScope = findTaskScope(false);
+    if (taskScope)
+    {
+        taskScope->scope = previous;
+        if (--taskScope->depth == 0)
+            taskScope->task = nullptr; // back in its default scope, the entry isn't needed anymore
+    }
+    portEXIT_CRITICAL(&heapTraceLock);
+}
+
+const char *heapScopeName(HeapScope scope)
+{
+    return scope < HEAP_SCOPE_COUNT ? scopeNames[scope] : "?";
+}
+
+HeapScopeStats getHeapScopeStats(HeapScope scope)
+{
+    portENTER_CRITICAL(&heapTraceLock);
+    HeapScopeStats stats = scopeStats[scope];
+    portEXIT_CRITICAL(&heapTraceLock);
+    return stats;
+}
+
+uint32_t getUntrackedAllocations()
+{
+    return untrackedAllocations;
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef HEAP_TRACE_H
+#define HEAP_TRACE_H
+
+#include <Arduino.h>
+
+/**
+ * Opt-in heap allocation tracing (ESP32 only), enabled by the esp32dev_heaptrace environment:
+ * -DHEAP_TRACE plus -Wl,--wrap for malloc, calloc, realloc and free.
+ *
+ * Every allocation is tagged with the scope active on the calling task. Tasks start in a scope
+ * picked from their name (loop task: app, async_tcp: web server, log_drain: logging, WiFi/lwIP/event
+ * tasks: wifi);
+ * a HeapTraceScope object switches the current task to another scope until it goes out of scope.
+ * Live allocations are kept in a fixed-size table, so frees are credited to the scope that allocated.
+ *
+ * Without HEAP_TRACE, HeapTraceScope compiles to nothing.
+ */
+enum HeapScope : uint8_t
+{
+    HEAP_SCOPE_OTHER,
+    HEAP_SCOPE_APP,
+    HEAP_SCOPE_WIFI,
+    HEAP_SCOPE_WEB_SERVER,
+    HEAP_SCOPE_OTA,
+    HEAP_SCOPE_LOGGING,
+    HEAP_SCOPE_COUNT
+};
+
+struct HeapScopeStats
+{
+    uint32_t liveBytes;
+    uint32_t peakBytes;
+    uint32_t allocations;
+    uint32_t frees;
+};
+
+#if defined(HEAP_TRACE) && defined(ESP32)
+
+class HeapTraceScope
+{
+public:
+    explicit HeapTraceScope(HeapScope scope);
+    ~HeapTraceScope();
+
+private:
+    HeapScope previous;
+};
+
+const char *heapScopeName(HeapScope scope);
+HeapScopeStats getHeapScopeStats(HeapScope scope);
+uint32_t getUntrackedAllocations();
+
+#else
+
+class HeapTraceScope
+{
+public:
+    explicit HeapTraceScope(HeapScope) {}
+};
+
+#endif
+
+#endif // HEAP_TRACE_H
@@ -0,0 +1,95 @@
+#include "common/html_template.h"
+
+size_t HtmlTemplateValue::write(uint8_t c)
+{
+    if (length >= sizeof(data))
+        return 0;
+    data[length++] = c;
+    return 1;
+}
+
+static const char *htmlEntity(char c)
+{
+    switch (c)
+    {
+    case '&':
+        return "&amp;";
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    case '"':
+        return "&quot;";
+    case '\'':
+        return "&#39;";
+    default:
+        return nullptr;
+    }
+}
+
+HtmlTemplateResponse::HtmlTemplateResponse(const char *page, HtmlTemplateResolver resolver, bool chunked)
+    : page(page), resolver(resolver)
+{
+    _code = 200;
+    _contentType = "text/html";
+    _contentLength = 0;
+    _sendContentLength = false;
+    _chunked = chunked;
+}
+
+// At "{{": reads the name up to "}}" and resolves it. Returns false if it isn't a placeholder.
+bool HtmlTemplateResponse::startPlaceholder()
+{
+    char name[HTML_TEMPLATE_NAME_SIZE];
+    size_t length = 0;
+    size_t end = position + 2;
+    while (true)
+    {
+        char c = pgm_read_byte(page + end);
+        if (c == '}' && pgm_read_byte(page + end + 1) == '}')
+            break;
+        if (c == '\0' || c == '{' || length + 1 >= sizeof(name))
+            return false;
+        name[length++] = c;
+        end++;
+    }
+    name[length] = '\0';
+
+    value.length = 0;
+    valueOffset = 0;
+    resolver(name, value);
+    position = end + 2;
+    return true;
+}
+
+size_t HtmlTemplateResponse::_fillBuffer(uint8_t *buf, size_t maxLen)
+{
+    size_t written = 0;
+    while (written < maxLen)
+    {
+        if (entity != nullptr)
+        {
+            buf[written++] = *entity++;
+            if (*entity == '\0')
+                entity = nullptr;
+            continue;
+        }
+        if (valueOffset < value.length)
+        {
+            char c = value.data[valueOffset++];
+            entity = htmlEntity(c);
+            if (entity == nullptr)
+                buf[written++] = c;
+            continue;
+        }
+
+        char c = pgm_read_byte(page + position);
+        if (c == '\0')
+            break;
+        if (c == '{' && pgm_read_byte(page + position + 1) == '{' && startPlaceholder())
+            continue;
+        buf[written++] = c;
+        position++;
+    }
+    return written;
+}
@@ -0,0 +1,62 @@
+#ifndef HTML_TEMPLATE_H
+#define HTML_TEMPLATE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#define HTML_TEMPLATE_NAME_SIZE 32   // longest placeholder name + 1
+#define HTML_TEMPLATE_VALUE_SIZE 160 // longer values are truncated
+
+/**
+ * Prints the value of a placeholder into out, returns false if name isn't known (it's left empty).
+ *
+ *   bool statusValue(const char *name, Print &out)
+ *   {
+ *       if (strcmp(name, "version") == 0)
+ *           out.print(SW_VERSION);
+ *       else
+ *           return false;
+ *       return true;
+ *   }
+ */
+typedef bool (*HtmlTemplateResolver)(const char *name, Print &out);
+
+// Collects a value, up to HTML_TEMPLATE_VALUE_SIZE bytes
+class HtmlTemplateValue : public Print
+{
+public:
+    size_t write(uint8_t c) override;
+    using Print::write;
+
+    char data[HTML_TEMPLATE_VALUE_SIZE];
+    size_t length = 0;
+};
+
+/**
+ * Renders a template stored in flash (PROGMEM), replacing every {{name}} with the HTML-escaped
+ * value the resolver prints for it. The page is streamed straight into the buffers handed over by
+ * the server, one value at a time: rendering needs the response object and nothing else, however
+ * long the page. Chunked on HTTP/1.1.
+ *
+ *   static const char statusPage[] PROGMEM = "<p>Version {{version}}</p>";
+ *   request->send(new HtmlTemplateResponse(statusPage, statusValue, request->version() > 0));
+ */
+class HtmlTemplateResponse : public AsyncAbstractResponse
+{
+public:
+    HtmlTemplateResponse(const char *page, HtmlTemplateResolver resolver, bool chunked);
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
+
+private:
+    bool startPlaceholder();
+
+    const char *page;
+    HtmlTemplateResolver resolver;
+    size_t position = 0;
+    HtmlTemplateValue value;
+    size_t valueOffset = 0;
+    const char *entity = nullptr; // escaped character being written
+};
+
+#endif // HTML_TEMPLATE_H
@@ -0,0 +1,196 @@
+#include "common/job_queue.h"
+
+#include <algorithm>
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#include "common/globals.h"
+
+struct Job
+{
+    JobStatus status; // status.id is 0 when the slot was never used
+    JobFunction run;
+};
+static Job jobs[JOB_SLOTS];
+static uint32_t nextJobId = 1;
+static Job *runningJob = nullptr;
+
+#ifdef ESP32
+static portMUX_TYPE jobsLock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t jobWorker = nullptr;
+#define LOCK_JOBS() portENTER_CRITICAL(&jobsLock)
+#define UNLOCK_JOBS() portEXIT_CRITICAL(&jobsLock)
+#elif defined(ESP8266)
+#define LOCK_JOBS()
+#define UNLOCK_JOBS()
+#endif
+
+static bool finished(const Job &job)
+{
+    return job.status.state == JOB_DONE || job.status.state == JOB_FAILED;
+}
+
+// A free slot, or the one of the oldest finished job. Must be called with the lock held.
+static Job *freeSlot()
+{
+    Job *slot = nullptr;
+    for (Job &job : jobs)
+    {
+        if (job.status.id == 0)
+            return &job;
+        if (finished(job) && (slot == nullptr || job.status.id < slot->status.id))
+            slot = &job;
+    }
+    return slot;
+}
+
+uint32_t enqueueJob(const char *name, JobFunction run)
+{
+    uint32_t id = 0;
+    LOCK_JOBS();
+    for (const Job &job : jobs)
+    {
+        if (job.status.id != 0 && !finished(job) && job.run == run)
+            id = job.status.id;
+    }
+    Job *slot = id == 0 ? freeSlot() : nullptr;
+    if (slot != nullptr)
+    {
+        id = nextJobId++;
+        slot->status = {id, name, JOB_QUEUED, 0, static_cast<uint32_t>(millis()), 0, 0};
+        slot->run = run;
+    }
+    UNLOCK_JOBS();
+
+    if (slot == nullptr && id == 0)
+    {
+        LOG_W("jobs", "queue full, %s not queued", name);
+        return 0;
+    }
+#ifdef ESP32
+    if (slot != nullptr)
+        xTaskNotifyGive(jobWorker);
+#endif
+    return id;
+}
+
+// The oldest queued job, now running, or nullptr
+static Job *startNextJob()
+{
+    Job *next = nullptr;
+    LOCK_JOBS();
+    for (Job &job : jobs)
+    {
+        if (job.status.id != 0 && job.status.state == JOB_QUEUED && (next == nullptr || job.status.id < next->status.id))
+            next = &job;
+    }
+    if (next != nullptr)
+    {
+        next->status.state = JOB_RUNNING;
+        next->status.startedMillis = millis();
+        runningJob = next;
+    }
+    UNLOCK_JOBS();
+    return next;
+}
+
+void runJobs()
+{
+    Job *job;
+    while ((job = startNextJob()) != nullptr)
+    {
+        LOG_I("jobs", "#%u %s started", job->status.id, job->status.name);
+        bool ok = job->run();
+
+        LOCK_JOBS();
+        job->status.state = ok ? JOB_DONE : JOB_FAILED;
+        job->status.finishedMillis = millis();
+        JobStatus status = job->status; // the slot can be reused once unlocked
+        runningJob = nullptr;
+        UNLOCK_JOBS();
+        LOG_I("jobs", "#%u %s %s in %u ms", status.id, status.name, ok ? "done" : "failed",
+              status.finishedMillis - status.startedMillis);
+    }
+}
+
+#ifdef ESP32
+static void jobWorkerTask(void *)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        runJobs();
+    }
+}
+#endif
+
+void beginJobQueue()
+{
+#ifdef ESP32
+    xTaskCreate(jobWorkerTask, "jobs", JOB_WORKER_STACK_SIZE, nullptr, 1, &jobWorker);
+#endif
+}
+
+void setJobProgress(uint8_t percent)
+{
+    LOCK_JOBS();
+    if (runningJob != nullptr)
+        runningJob->status.progress = std::min<uint8_t>(percent, 100);
+    UNLOCK_JOBS();
+}
+
+bool isJobRunning()
+{
+    LOCK_JOBS();
+    bool running = runningJob != nullptr;
+    UNLOCK_JOBS();
+    return running;
+}
+
+bool getJobStatus(uint32_t id, JobStatus &status)
+{
+    bool found = false;
+    LOCK_JOBS();
+    for (const Job &job : jobs)
+    {
+        if (id != 0 && job.status.id == id)
+        {
+            status = job.status;
+            found = true;
+        }
+    }
+    UNLOCK_JOBS();
+    return found;
+}
+
+size_t getJobStatuses(JobStatus *statuses, size_t maxCount)
+{
+    size_t count = 0;
+    LOCK_JOBS();
+    for (const Job &job : jobs)
+    {
+        if (count < maxCount && job.status.id != 0)
+            statuses[count++] = job.status;
+    }
+    UNLOCK_JOBS();
+    std::sort(statuses, statuses + count, [](const JobStatus &a, const JobStatus &b)
+              { return a.id < b.id; });
+    return count;
+}
+
+const char *jobStateName(JobState state)
+{
+    switch (state)
+    {
+    case JOB_QUEUED:
+        return "queued";
+    case JOB_RUNNING:
+        return "running";
+    case JOB_DONE:
+        return "done";
+    default:
+        return "failed";
+    }
+}
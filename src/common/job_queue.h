@@ -0,0 +1,57 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include <Arduino.h>
+
+#define JOB_SLOTS 8                 // queued, running and finished jobs kept for /api/jobs
+#define JOB_WORKER_STACK_SIZE 8192 // ESP32 worker task, enough for the TLS of an OTA check
+
+enum JobState : uint8_t
+{
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE,
+    JOB_FAILED
+};
+
+// Runs on the worker, returns false if it failed
+typedef bool (*JobFunction)();
+
+struct JobStatus
+{
+    uint32_t id;
+    const char *name;
+    JobState state;
+    uint8_t progress; // percent, as reported by the job
+    uint32_t queuedMillis;
+    uint32_t startedMillis;
+    uint32_t finishedMillis;
+};
+
+/**
+ * Slow work (OTA checks, reboots) is queued here and run one job at a time by a worker: its own
+ * task on ESP32, commonLoop on ESP8266. Handlers answer right away, so the async_tcp task never
+ * waits on it:
+ *
+ *   uint32_t id = enqueueJob("reboot", rebootJob);
+ *   sendJobAccepted(request, id); // 202, or 503 if id is 0
+ *
+ * A function already queued or running isn't queued twice, its job id is returned instead.
+ * When all slots hold unfinished jobs, enqueueJob returns 0. Finished jobs stay listed until
+ * their slot is reused, oldest first.
+ */
+void beginJobQueue();
+uint32_t enqueueJob(const char *name, JobFunction run);
+void runJobs(); // ESP8266: runs the queued jobs, from commonLoop
+
+// Called by a running job
+void setJobProgress(uint8_t percent);
+
+// True while a job runs: the loop leaves WiFi and OTA alone meanwhile
+bool isJobRunning();
+
+bool getJobStatus(uint32_t id, JobStatus &status);
+size_t getJobStatuses(JobStatus *statuses, size_t maxCount); // oldest first
+const char *jobStateName(JobState state);
+
+#endif // JOB_QUEUE_H
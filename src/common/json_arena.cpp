@@ -0,0 +1,80 @@
+#include "common/json_arena.h"
+
+// Each block is preceded by its size, so that the last one can grow in place
+struct JsonArenaBlock
+{
+    size_t size;
+    size_t padding; // keeps the blocks 8 bytes aligned
+};
+
+class JsonArena : public ArduinoJson::Allocator
+{
+public:
+    void *allocate(size_t size) override
+    {
+        size_t needed = sizeof(JsonArenaBlock) + align(size);
+        if (needed > sizeof(buffer) - used)
+            return nullptr;
+        JsonArenaBlock *block = reinterpret_cast<JsonArenaBlock *>(buffer + used);
+        block->size = size;
+        last = block;
+        used += needed;
+        peak = std::max(peak, used);
+        return block + 1;
+    }
+
+    void deallocate(void *ptr) override {}
+
+    void *reallocate(void *ptr, size_t newSize) override
+    {
+        if (ptr == nullptr)
+            return allocate(newSize);
+        JsonArenaBlock *block = static_cast<JsonArenaBlock *>(ptr) - 1;
+        if (block == last)
+        {
+            size_t start = reinterpret_cast<uint8_t *>(block) - buffer;
+            if (sizeof(JsonArenaBlock) + align(newSize) > sizeof(buffer) - start)
+                return nullptr;
+            block->size = newSize;
+            used = start + sizeof(JsonArenaBlock) + align(newSize);
+            peak = std::max(peak, used);
+            return ptr;
+        }
+        if (newSize <= block->size)
+        {
+            block->size = newSize;
+            return ptr;
+        }
+        void *moved = allocate(newSize);
+        if (moved != nullptr)
+            memcpy(moved, ptr, block->size);
+        return moved;
+    }
+
+    void reset()
+    {
+        used = 0;
+        last = nullptr;
+    }
+
+    size_t peak = 0;
+
+private:
+    static size_t align(size_t size) { return (size + 7) & ~static_cast<size_t>(7); }
+
+    alignas(8) uint8_t buffer[JSON_ARENA_SIZE];
+    size_t used = 0;
+    JsonArenaBlock *last = nullptr;
+};
+static JsonArena jsonArena;
+
+ArduinoJson::Allocator *resetJsonArena()
+{
+    jsonArena.reset();
+    return &jsonArena;
+}
+
+size_t getJsonArenaPeakBytes()
+{
+    return jsonArena.peak;
+}
@@ -0,0 +1,28 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#ifdef ESP32
+#define JSON_ARENA_SIZE 3072 // bytes
+#elif defined(ESP8266)
+#define JSON_ARENA_SIZE 2048
+#endif
+
+/**
+ * Gives a JsonDocument a fixed, static buffer instead of the heap:
+ *
+ *   JsonDocument doc(resetJsonArena());
+ *   doc["version"] = SW_VERSION;
+ *   if (!doc.overflowed())
+ *       serializeJson(doc, *response);
+ *
+ * Memory is handed out from the start of the buffer and only given back by the next
+ * resetJsonArena(), so there's one document at a time: the web server handlers, which all run
+ * on the same task. A document that doesn't fit is overflowed(), it never falls back to the heap.
+ */
+ArduinoJson::Allocator *resetJsonArena();
+size_t getJsonArenaPeakBytes();
+
+#endif // JSON_ARENA_H
@@ -0,0 +1,79 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include "common/log_pipeline.h"
+
+// Log levels
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
+
+// Uncomment the following line to enable debug output.
+// #define DEBUG
+
+// Messages above LOG_LEVEL are compiled out, arguments included. Set it with a build flag
+// (-DLOG_LEVEL=LOG_LEVEL_TRACE), or per file by defining it before including this header
+// (or common/globals.h, which includes it).
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+/**
+ * Leveled, tagged logging, formatted printf-style into a stack buffer:
+ *
+ *   LOG_W("wifi", "connection lost, status %d", WiFi.status());
+ *
+ * Nothing is formatted unless a sink (Serial, or the logs websocket when a client is connected)
+ * wants that level for that tag, see setLogSinkLevel() and setLogTagLevel().
+ */
+#define LOG_AT(level, tag, format, ...)                                                 \
+    {                                                                                   \
+        if (LOG_LEVEL >= level)                                                         \
+        {                                                                               \
+            uint8_t logSinks_ = logSinksFor(level, tag);                                \
+            if (logSinks_)                                                              \
+                LOG_EMIT(logSinks_, level, tag, format, ##__VA_ARGS__);                 \
+        }                                                                               \
+    }
+#ifdef LOG_BINARY
+// Only the format id and the raw arguments are queued, see common/log_binary.h. Tag and format must be literals.
+#define LOG_EMIT(sinks, level, tag, format, ...)                                                           \
+    {                                                                                                      \
+        if (false)                                                                                         \
+            logCheckFormat(format, ##__VA_ARGS__);                                                         \
+        logBinary(sinks, level, std::integral_constant<uint32_t, logFormatId(tag, format)>::value, ##__VA_ARGS__); \
+    }
+#else
+#define LOG_EMIT(sinks, level, tag, format, ...) logPrintf(sinks, level, tag, PSTR(format), ##__VA_ARGS__)
+#endif
+#define LOG_E(tag, format, ...) LOG_AT(LOG_LEVEL_ERROR, tag, format, ##__VA_ARGS__)
+#define LOG_W(tag, format, ...) LOG_AT(LOG_LEVEL_WARN, tag, format, ##__VA_ARGS__)
+#define LOG_I(tag, format, ...) LOG_AT(LOG_LEVEL_INFO, tag, format, ##__VA_ARGS__)
+#define LOG_D(tag, format, ...) LOG_AT(LOG_LEVEL_DEBUG, tag, format, ##__VA_ARGS__)
+#define LOG_T(tag, format, ...) LOG_AT(LOG_LEVEL_TRACE, tag, format, ##__VA_ARGS__)
+
+// Untagged messages, as they are given (String, const char * or F() string)
+#define LOG_RAW(level, print, str)                             \
+    {                                                          \
+        if (LOG_LEVEL >= level)                                \
+        {                                                      \
+            uint8_t logSinks_ = logSinksFor(level, nullptr);   \
+            if (logSinks_)                                     \
+                print(logSinks_, str);                         \
+        }                                                      \
+    }
+
+// LOG to Serial and to WebSocket, through the log pipeline (see common/log_pipeline.h)
+#define LOG_PRINT(str) LOG_RAW(LOG_LEVEL_INFO, logPrint, str)
+#define LOG_PRINTLN(str) LOG_RAW(LOG_LEVEL_INFO, logPrintln, str)
+#define DEBUG_PRINT(str) LOG_RAW(LOG_LEVEL_DEBUG, logPrint, str)
+#define DEBUG_PRINTLN(str) LOG_RAW(LOG_LEVEL_DEBUG, logPrintln, str)
+
+#endif // LOG_H
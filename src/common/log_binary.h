@@ -0,0 +1,112 @@
+#ifndef LOG_BINARY_H
+#define LOG_BINARY_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+/**
+ * Binary log records, sent instead of text when building with -DLOG_BINARY:
+ *
+ *   0x1E | level (1) | format id (4) | millis (4) | payload length (2) | payload
+ *
+ * (little endian). The format id is the FNV-1a hash of the tag, 0x1F and the format string,
+ * computed at compile time, so neither string is stored in flash; extra_script_log_formats.py
+ * computes the same ids from the sources into log_formats.json, which tools/log_decoder.py uses
+ * to render the records. The payload holds the raw arguments: integers as 4 bytes (8 for 64 bits),
+ * floating point as 8 byte doubles, strings as a length byte followed by at most 255 characters.
+ * Format id 0 is untagged text (LOG_PRINT, DEBUG_PRINT), whose payload is the text itself.
+ */
+#define LOG_BINARY_RECORD_START 0x1E
+#define LOG_BINARY_HEADER_SIZE 12
+#define LOG_BINARY_MAX_ARGS_SIZE 128
+
+constexpr uint32_t logFnv(const char *s, uint32_t hash)
+{
+    return *s ? logFnv(s + 1, (hash ^ static_cast<uint8_t>(*s)) * 16777619u) : hash;
+}
+
+constexpr uint32_t logNonZeroId(uint32_t hash)
+{
+    return hash ? hash : 1;
+}
+
+constexpr uint32_t logFormatId(const char *tag, const char *format)
+{
+    return logNonZeroId(logFnv(format, (logFnv(tag, 2166136261u) ^ 0x1Fu) * 16777619u));
+}
+
+void logPushBinary(uint8_t sinks, uint8_t level, uint32_t id, const uint8_t *args, size_t length);
+
+// Never called: lets the compiler check the arguments against the format, as in text mode
+inline void logCheckFormat(const char *, ...) __attribute__((format(printf, 1, 2)));
+inline void logCheckFormat(const char *, ...) {}
+
+struct LogArgWriter
+{
+    uint8_t *data;
+    size_t capacity;
+    size_t length;
+
+    void put(const void *value, size_t size)
+    {
+        size = std::min(size, capacity - length);
+        memcpy(data + length, value, size);
+        length += size;
+    }
+};
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type logEncodeArg(LogArgWriter &writer, T value)
+{
+    if (sizeof(T) > 4)
+    {
+        uint64_t wide = static_cast<uint64_t>(value);
+        writer.put(&wide, 8);
+    }
+    else
+    {
+        uint32_t narrow = static_cast<uint32_t>(value);
+        writer.put(&narrow, 4);
+    }
+}
+
+inline void logEncodeArg(LogArgWriter &writer, double value)
+{
+    writer.put(&value, 8);
+}
+
+inline void logEncodeArg(LogArgWriter &writer, const char *value)
+{
+    if (value == nullptr)
+        value = "(null)";
+    uint8_t length = std::min<size_t>(strlen(value), 255);
+    writer.put(&length, 1);
+    writer.put(value, length);
+}
+
+template <typename T>
+void logEncodeArg(LogArgWriter &writer, const T *value)
+{
+    uint32_t address = reinterpret_cast<uintptr_t>(value);
+    writer.put(&address, 4);
+}
+
+inline void logEncodeArgs(LogArgWriter &) {}
+
+template <typename T, typename... Rest>
+void logEncodeArgs(LogArgWriter &writer, const T &first, const Rest &...rest)
+{
+    logEncodeArg(writer, first);
+    logEncodeArgs(writer, rest...);
+}
+
+template <typename... Args>
+void logBinary(uint8_t sinks, uint8_t level, uint32_t id, const Args &...args)
+{
+    uint8_t data[LOG_BINARY_MAX_ARGS_SIZE];
+    LogArgWriter writer = {data, sizeof(data), 0};
+    logEncodeArgs(writer, args...);
+    logPushBinary(sinks, level, id, data, writer.length);
+}
+
+#endif // LOG_BINARY_H
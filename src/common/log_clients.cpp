@@ -0,0 +1,199 @@
+#include "common/log_clients.h"
+
+#include "common/globals.h"
+#include "common/heap_trace.h"
+
+#ifdef ESP32
+#include <freertos/semphr.h>
+#endif
+
+static_assert(LOG_CLIENT_BUFFER_SIZE >= LOG_MAX_LINE_LENGTH, "a line must fit in a client buffer");
+
+struct LogClient
+{
+    uint32_t id;       // set by onEvent, 0 when the slot is free
+    uint32_t servedId; // the client the rest belongs to, only touched by the drain
+    AsyncWebSocketClient *socket; // set and cleared with the lock held, as the library deletes it
+    uint32_t replayEndSeq;        // set before id, the history replayed to the client stops there
+    uint32_t skipBeforeSeq;       // replayEndSeq of the client served, only touched by the drain
+    uint32_t pendingSinceMillis;
+    size_t pendingLength;
+    uint32_t unreportedDroppedLines;
+    LogClientStats stats;
+    char pending[LOG_CLIENT_BUFFER_SIZE];
+};
+static LogClient logClients[LOG_CLIENT_MAX];
+static uint32_t totalDroppedLines = 0;
+
+// Slots are claimed from the async_tcp task on ESP32; on ESP8266 everything runs on the same context
+static bool swapClientId(LogClient &client, uint32_t expected, uint32_t id)
+{
+#ifdef ESP32
+    return __atomic_compare_exchange_n(&client.id, &expected, id, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#elif defined(ESP8266)
+    if (client.id != expected)
+        return false;
+    client.id = id;
+    return true;
+#endif
+}
+
+#ifdef ESP32
+static SemaphoreHandle_t logClientsMutex()
+{
+    static SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+    return mutex;
+}
+
+void lockLogClients()
+{
+    xSemaphoreTake(logClientsMutex(), portMAX_DELAY);
+}
+
+void unlockLogClients()
+{
+    xSemaphoreGive(logClientsMutex());
+}
+#elif defined(ESP8266)
+void lockLogClients() {}
+void unlockLogClients() {}
+#endif
+
+bool addLogClient(AsyncWebSocketClient *socket, uint32_t replayEndSeq)
+{
+    for (LogClient &client : logClients)
+    {
+        if (__atomic_load_n(&client.id, __ATOMIC_ACQUIRE) != 0)
+            continue;
+        // Only onEvent claims slots, with the lock held: the slot stays free until the swap publishes it
+        client.socket = socket;
+        client.replayEndSeq = replayEndSeq;
+        return swapClientId(client, 0, socket->id());
+    }
+    return false;
+}
+
+void removeLogClient(uint32_t id)
+{
+    for (LogClient &client : logClients)
+    {
+        if (client.id == id)
+            client.socket = nullptr;
+        swapClientId(client, id, 0);
+    }
+}
+
+// Starts the slot over when its client changed since the drain last looked at it
+static void syncClient(LogClient &client)
+{
+    uint32_t id = __atomic_load_n(&client.id, __ATOMIC_ACQUIRE);
+    if (id == client.servedId)
+        return;
+    client.servedId = id;
+    client.skipBeforeSeq = client.replayEndSeq;
+    client.pendingLength = 0;
+    client.unreportedDroppedLines = 0;
+    client.stats = {};
+    client.stats.id = id;
+}
+
+void queueLogClients(uint32_t seq, const uint8_t *data, size_t length, const uint8_t *more, size_t moreLength)
+{
+    for (LogClient &client : logClients)
+    {
+        syncClient(client);
+        if (client.servedId == 0 || static_cast<int32_t>(seq - client.skipBeforeSeq) < 0)
+            continue; // no client, or the line was in its replay
+
+        if (client.pendingLength + length + moreLength > LOG_CLIENT_BUFFER_SIZE)
+        {
+            size_t needed = client.pendingLength + length + moreLength - LOG_CLIENT_BUFFER_SIZE;
+            size_t dropped = 0;
+            while (dropped < needed)
+            {
+                dropped += logEntryLength(client.pending + dropped, client.pendingLength - dropped);
+                client.unreportedDroppedLines++;
+                client.stats.droppedLines++;
+                totalDroppedLines++;
+            }
+            memmove(client.pending, client.pending + dropped, client.pendingLength - dropped);
+            client.pendingLength -= dropped;
+        }
+        if (client.pendingLength == 0)
+            client.pendingSinceMillis = millis();
+        memcpy(client.pending + client.pendingLength, data, length);
+        memcpy(client.pending + client.pendingLength + length, more, moreLength);
+        client.pendingLength += length + moreLength;
+        client.stats.queuedBytes = client.pendingLength;
+    }
+}
+
+static bool congested(AsyncWebSocketClient *client)
+{
+    AsyncClient *tcp = client->client();
+    return !client->canSend() || tcp == nullptr || tcp->space() < LOG_CLIENT_MIN_SEND_SPACE;
+}
+
+static void sendPending(LogClient &slot, AsyncWebSocketClient *client)
+{
+    char marker[LOG_DROP_MARKER_SIZE];
+    size_t markerLength = 0;
+    if (slot.unreportedDroppedLines > 0)
+        markerLength = writeLogDropMarker(marker, slot.unreportedDroppedLines);
+
+    AsyncWebSocketMessageBuffer *buffer = wsLogs.makeBuffer(markerLength + slot.pendingLength);
+    if (buffer == nullptr)
+        return; // out of memory: try again with the next drain
+    memcpy(buffer->get(), marker, markerLength);
+    memcpy(buffer->get() + markerLength, slot.pending, slot.pendingLength);
+#ifdef LOG_BINARY
+    client->binary(buffer); // decoded by tools/log_decoder.py
+#else
+    client->text(buffer);
+#endif
+
+    slot.stats.frames++;
+    slot.stats.bytes += markerLength + slot.pendingLength;
+    if (slot.pendingLength > 0)
+    {
+        slot.stats.lastLatencyMs = millis() - slot.pendingSinceMillis;
+        slot.stats.maxLatencyMs = std::max(slot.stats.maxLatencyMs, slot.stats.lastLatencyMs);
+    }
+    slot.pendingLength = 0;
+    slot.unreportedDroppedLines = 0;
+    slot.stats.queuedBytes = 0;
+}
+
+void sendLogClients()
+{
+    HeapTraceScope heapTraceScope(HEAP_SCOPE_LOGGING);
+    lockLogClients();
+    for (LogClient &slot : logClients)
+    {
+        syncClient(slot);
+        if (slot.servedId == 0 || (slot.pendingLength == 0 && slot.unreportedDroppedLines == 0))
+            continue;
+        // Not looked up in wsLogs: its client list is changed on async_tcp without a lock
+        AsyncWebSocketClient *client = slot.id == slot.servedId ? slot.socket : nullptr;
+        if (client == nullptr || congested(client))
+            continue;
+        sendPending(slot, client);
+    }
+    unlockLogClients();
+}
+
+size_t getLogClientStats(LogClientStats *stats, size_t maxCount)
+{
+    size_t count = 0;
+    for (const LogClient &client : logClients)
+    {
+        if (count < maxCount && client.servedId != 0)
+            stats[count++] = client.stats;
+    }
+    return count;
+}
+
+uint32_t getLogClientDroppedLines()
+{
+    return totalDroppedLines;
+}
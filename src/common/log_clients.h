@@ -0,0 +1,56 @@
+#ifndef LOG_CLIENTS_H
+#define LOG_CLIENTS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#ifdef ESP32
+#define LOG_CLIENT_MAX 4
+#define LOG_CLIENT_BUFFER_SIZE 2048 // bytes of lines waiting per client
+#elif defined(ESP8266)
+#define LOG_CLIENT_MAX 2
+#define LOG_CLIENT_BUFFER_SIZE 1024
+#endif
+#define LOG_CLIENT_MIN_SEND_SPACE 1024 // free TCP send buffer a client needs before it gets another frame
+
+/**
+ * Each logs websocket client gets its own buffer of lines waiting to be sent, instead of a copy
+ * of every frame queued in the server. A client is sent a frame only when its previous frames
+ * have left: the server queue has room and at most TCP_SND_BUF - LOG_CLIENT_MIN_SEND_SPACE bytes
+ * are in flight. Until then its lines are coalesced into the next frame, and once the buffer is
+ * full its oldest lines are dropped; the frame then starts with a "N lines dropped" marker.
+ * A slow client costs at most LOG_CLIENT_BUFFER_SIZE, and doesn't hold back the others.
+ *
+ * Clients are added and removed from onEvent; lines are queued and sent by the log drain.
+ * The library deletes a client on async_tcp right after its disconnect event, so onEvent holds
+ * lockLogClients() around a log client's connect and disconnect, and the drain holds it while it
+ * sends: a client the drain is sending to stays alive until it's done.
+ */
+struct LogClientStats
+{
+    uint32_t id;
+    uint32_t queuedBytes;    // waiting in the client buffer
+    uint32_t droppedLines;   // because the client couldn't keep up
+    uint32_t frames;
+    uint32_t bytes;
+    uint32_t lastLatencyMs;  // how long the oldest line of the last frame waited
+    uint32_t maxLatencyMs;
+};
+
+void lockLogClients();
+void unlockLogClients();
+
+// With the lock held. A client is sent the lines from replayEndSeq on, the ones before are in the
+// history replayed to it. False when LOG_CLIENT_MAX clients are served already.
+bool addLogClient(AsyncWebSocketClient *socket, uint32_t replayEndSeq);
+void removeLogClient(uint32_t id);
+
+// Queues the line (data, then more) with history sequence number seq
+void queueLogClients(uint32_t seq, const uint8_t *data, size_t length, const uint8_t *more = nullptr, size_t moreLength = 0);
+void sendLogClients();
+
+// Fills stats for the clients being served, and returns how many
+size_t getLogClientStats(LogClientStats *stats, size_t maxCount);
+uint32_t getLogClientDroppedLines(); // over all clients since boot
+
+#endif // LOG_CLIENTS_H
@@ -0,0 +1,237 @@
+#include "common/log_history.h"
+
+#include <stddef.h>
+
+#ifdef ESP32
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#endif
+
+#define LOG_HISTORY_MAGIC 0x4C4F4748u // "LOGH"
+#define LOG_HISTORY_RECORD_HEADER_SIZE 6u // seq (4) + length (2)
+
+static_assert((LOG_HISTORY_SIZE & (LOG_HISTORY_SIZE - 1)) == 0, "LOG_HISTORY_SIZE must be a power of 2");
+
+// Records are their sequence number and length followed by the bytes, unpadded, wrapping around.
+// Positions are free-running, taken modulo LOG_HISTORY_SIZE.
+struct LogHistory
+{
+    uint32_t magic;
+    uint32_t bootCount;
+    uint32_t firstSeq; // sequence number of the record at tail
+    uint32_t nextSeq;
+    uint32_t tail;
+    uint32_t head;
+    uint8_t data[LOG_HISTORY_SIZE];
+};
+
+#ifdef ESP32
+static __NOINIT_ATTR LogHistory history;
+static portMUX_TYPE historyLock = portMUX_INITIALIZER_UNLOCKED;
+#define LOCK_HISTORY() portENTER_CRITICAL(&historyLock)
+#define UNLOCK_HISTORY() portEXIT_CRITICAL(&historyLock)
+#elif defined(ESP8266)
+static LogHistory history;
+#define LOCK_HISTORY()
+#define UNLOCK_HISTORY()
+#endif
+
+static void copyIn(uint32_t position, const uint8_t *data, size_t length)
+{
+    size_t offset = position % LOG_HISTORY_SIZE;
+    size_t first = std::min(length, LOG_HISTORY_SIZE - offset);
+    memcpy(history.data + offset, data, first);
+    memcpy(history.data, data + first, length - first);
+}
+
+static void copyOut(uint32_t position, uint8_t *out, size_t length)
+{
+    size_t offset = position % LOG_HISTORY_SIZE;
+    size_t first = std::min(length, LOG_HISTORY_SIZE - offset);
+    memcpy(out, history.data + offset, first);
+    memcpy(out + first, history.data, length - first);
+}
+
+static void readRecordHeader(uint32_t position, uint32_t &seq, uint16_t &length)
+{
+    uint8_t header[LOG_HISTORY_RECORD_HEADER_SIZE];
+    copyOut(position, header, sizeof(header));
+    memcpy(&seq, header, 4);
+    memcpy(&length, header + 4, 2);
+}
+
+// Whatever survived the reset is only trusted if every record checks out
+static bool historyValid()
+{
+    if (history.magic != LOG_HISTORY_MAGIC || history.head - history.tail > LOG_HISTORY_SIZE)
+        return false;
+    uint32_t position = history.tail;
+    uint32_t expectedSeq = history.firstSeq;
+    while (position != history.head)
+    {
+        uint32_t seq;
+        uint16_t length;
+        if (history.head - position < LOG_HISTORY_RECORD_HEADER_SIZE)
+            return false;
+        readRecordHeader(position, seq, length);
+        if (seq != expectedSeq || history.head - position < LOG_HISTORY_RECORD_HEADER_SIZE + length)
+            return false;
+        position += LOG_HISTORY_RECORD_HEADER_SIZE + length;
+        expectedSeq++;
+    }
+    return expectedSeq == history.nextSeq;
+}
+
+// Moves seq into [firstSeq, nextSeq] and returns the position of its record. Call with the lock held.
+static uint32_t findRecord(uint32_t &seq)
+{
+    if (static_cast<int32_t>(seq - history.firstSeq) < 0)
+        seq = history.firstSeq;
+    if (static_cast<int32_t>(seq - history.nextSeq) > 0)
+        seq = history.nextSeq;
+    uint32_t position = history.tail;
+    for (uint32_t s = history.firstSeq; s != seq; s++)
+    {
+        uint32_t recordSeq;
+        uint16_t length;
+        readRecordHeader(position, recordSeq, length);
+        position += LOG_HISTORY_RECORD_HEADER_SIZE + length;
+    }
+    return position;
+}
+
+void beginLogHistory()
+{
+    if (!historyValid())
+    {
+        memset(&history, 0, offsetof(LogHistory, data));
+        history.magic = LOG_HISTORY_MAGIC;
+    }
+    history.bootCount++;
+}
+
+uint32_t appendLogHistory(const uint8_t *data, size_t length, const uint8_t *more, size_t moreLength)
+{
+    uint16_t recordLength = length + moreLength;
+    uint32_t recordSize = LOG_HISTORY_RECORD_HEADER_SIZE + recordLength;
+    if (recordSize > LOG_HISTORY_SIZE)
+        return getLogHistoryNextSeq(); // not kept, and not in any replay either
+
+    LOCK_HISTORY();
+    while (LOG_HISTORY_SIZE - (history.head - history.tail) < recordSize)
+    {
+        uint32_t seq;
+        uint16_t oldLength;
+        readRecordHeader(history.tail, seq, oldLength);
+        history.tail += LOG_HISTORY_RECORD_HEADER_SIZE + oldLength;
+        history.firstSeq++;
+    }
+
+    // The record is written past head before being counted in, so a reset halfway leaves a valid history
+    uint8_t header[LOG_HISTORY_RECORD_HEADER_SIZE];
+    memcpy(header, &history.nextSeq, 4);
+    memcpy(header + 4, &recordLength, 2);
+    copyIn(history.head, header, sizeof(header));
+    copyIn(history.head + sizeof(header), data, length);
+    copyIn(history.head + sizeof(header) + length, more, moreLength);
+    history.head += recordSize;
+    uint32_t seq = history.nextSeq++;
+    UNLOCK_HISTORY();
+    return seq;
+}
+
+uint32_t getLogHistoryBootCount()
+{
+    return history.bootCount;
+}
+
+uint32_t getLogHistoryFirstSeq()
+{
+    LOCK_HISTORY();
+    uint32_t seq = history.firstSeq;
+    UNLOCK_HISTORY();
+    return seq;
+}
+
+uint32_t getLogHistoryNextSeq()
+{
+    LOCK_HISTORY();
+    uint32_t seq = history.nextSeq;
+    UNLOCK_HISTORY();
+    return seq;
+}
+
+size_t getLogHistorySize(uint32_t seq, uint32_t endSeq)
+{
+    size_t size = 0;
+    LOCK_HISTORY();
+    uint32_t position = findRecord(seq);
+    for (; seq != endSeq && position != history.head; seq++)
+    {
+        uint32_t recordSeq;
+        uint16_t length;
+        readRecordHeader(position, recordSeq, length);
+        size += length;
+        position += LOG_HISTORY_RECORD_HEADER_SIZE + length;
+    }
+    UNLOCK_HISTORY();
+    return size;
+}
+
+size_t readLogHistory(LogHistoryCursor &cursor, uint32_t endSeq, uint8_t *out, size_t maxLen)
+{
+    size_t copied = 0;
+    LOCK_HISTORY();
+    if (!cursor.located || static_cast<int32_t>(cursor.seq - history.firstSeq) < 0)
+    {
+        uint32_t requested = cursor.seq;
+        cursor.position = findRecord(cursor.seq);
+        cursor.located = true;
+        if (cursor.seq != requested)
+            cursor.offset = 0; // the record being read was dropped meanwhile
+    }
+    while (copied < maxLen && cursor.seq != endSeq && cursor.position != history.head)
+    {
+        uint32_t recordSeq;
+        uint16_t length;
+        readRecordHeader(cursor.position, recordSeq, length);
+        size_t count = std::min(maxLen - copied, length - cursor.offset);
+        copyOut(cursor.position + LOG_HISTORY_RECORD_HEADER_SIZE + cursor.offset, out + copied, count);
+        copied += count;
+        cursor.offset += count;
+        if (cursor.offset == length)
+        {
+            cursor.offset = 0;
+            cursor.seq++;
+            cursor.position += LOG_HISTORY_RECORD_HEADER_SIZE + length;
+        }
+    }
+    UNLOCK_HISTORY();
+    return copied;
+}
+
+LogHistoryResponse::LogHistoryResponse(uint32_t since, bool chunked) : cursor(since), endSeq(getLogHistoryNextSeq())
+{
+    _code = 200;
+#ifdef LOG_BINARY
+    _contentType = "application/octet-stream";
+#else
+    _contentType = "text/plain";
+#endif
+    _contentLength = 0;
+    _sendContentLength = false;
+    _chunked = chunked;
+
+    uint32_t firstSeq = getLogHistoryFirstSeq();
+    if (static_cast<int32_t>(cursor.seq - firstSeq) < 0)
+        cursor.seq = firstSeq;
+    if (static_cast<int32_t>(cursor.seq - endSeq) > 0)
+        cursor.seq = endSeq;
+    addHeader("X-Log-First-Seq", String(cursor.seq));
+    addHeader("X-Log-Next-Seq", String(endSeq));
+}
+
+size_t LogHistoryResponse::_fillBuffer(uint8_t *buf, size_t maxLen)
+{
+    return readLogHistory(cursor, endSeq, buf, maxLen);
+}
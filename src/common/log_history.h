@@ -0,0 +1,67 @@
+#ifndef LOG_HISTORY_H
+#define LOG_HISTORY_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#ifdef ESP32
+#define LOG_HISTORY_SIZE 4096
+#elif defined(ESP8266)
+#define LOG_HISTORY_SIZE 2048
+#endif
+
+/**
+ * The last LOG_HISTORY_SIZE bytes of log records, oldest dropped first, each with a sequence number
+ * that keeps growing across resets. On ESP32 the history is kept in .noinit RAM, which survives
+ * software resets, panics and watchdog resets (not power loss); it is validated at boot and
+ * started over if it doesn't check out. On ESP8266 it is lost on reset.
+ *
+ * Records are appended by the log drain, as they are sent (text, or binary records with LOG_BINARY).
+ */
+void beginLogHistory();
+// Returns the record's sequence number
+uint32_t appendLogHistory(const uint8_t *data, size_t length, const uint8_t *more = nullptr, size_t moreLength = 0);
+
+uint32_t getLogHistoryBootCount();
+uint32_t getLogHistoryFirstSeq(); // oldest record still kept
+uint32_t getLogHistoryNextSeq();  // sequence number of the next record
+
+// Bytes of the records from seq (or the oldest one kept) up to endSeq
+size_t getLogHistorySize(uint32_t seq, uint32_t endSeq);
+
+// Where a reader is in the history. The record's position is kept while the record is, so that
+// reading on doesn't walk the history from its oldest record again.
+struct LogHistoryCursor
+{
+    uint32_t seq;
+    size_t offset = 0;     // bytes of the record at seq read already
+    uint32_t position = 0; // of the record at seq
+    bool located = false;  // position is set
+
+    explicit LogHistoryCursor(uint32_t seq) : seq(seq) {}
+};
+
+/**
+ * Copies up to maxLen bytes of the records from the cursor (or the oldest one kept, if it was
+ * dropped) and stops at endSeq. Advances the cursor past what was copied.
+ */
+size_t readLogHistory(LogHistoryCursor &cursor, uint32_t endSeq, uint8_t *out, size_t maxLen);
+
+/**
+ * Streams the records from a sequence number up to the last one at the time of the request.
+ * The X-Log-First-Seq header tells the first one sent (greater than requested if older records
+ * were dropped), X-Log-Next-Seq the one to ask for next.
+ */
+class LogHistoryResponse : public AsyncAbstractResponse
+{
+public:
+    LogHistoryResponse(uint32_t since, bool chunked);
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override;
+
+private:
+    LogHistoryCursor cursor;
+    uint32_t endSeq;
+};
+
+#endif // LOG_HISTORY_H
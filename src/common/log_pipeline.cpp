@@ -0,0 +1,361 @@
+#include "common/log_pipeline.h"
+
+#include <stdarg.h>
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#include "common/globals.h"
+#include "common/log_clients.h"
+#include "common/log_history.h"
+#include "common/log_uart.h"
+
+#define LOG_RECORD_COMMITTED 0x80000000u
+#define LOG_RECORD_SINKS_SHIFT 16
+#define LOG_RECORD_LENGTH_MASK 0xFFFFu
+#define LOG_RECORD_HEADER_SIZE 4
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of 2");
+static_assert(LOG_MAX_LINE_LENGTH <= LOG_BATCH_SIZE, "a line must fit in a batch");
+
+// Records are a header word (LOG_RECORD_COMMITTED | sinks << 16 | length) followed by the line, padded to 4 bytes,
+// so headers are always aligned words. Positions are free-running, taken modulo LOG_RING_SIZE.
+static uint32_t ringWords[LOG_RING_SIZE / 4];
+static uint8_t *const ring = reinterpret_cast<uint8_t *>(ringWords);
+static uint32_t reserveHead = 0; // next position to be reserved by a producer
+static uint32_t readTail = 0;    // start of the oldest record, only moved by the drain
+static uint32_t droppedLines = 0;
+static uint32_t reportedDroppedLines = 0;
+
+struct LogBatch
+{
+    char data[LOG_BATCH_SIZE];
+    size_t length;
+};
+static LogBatch serialBatch;
+
+static uint8_t sinkLevels[2] = {LOG_LEVEL_TRACE, LOG_LEVEL_TRACE}; // serial, websocket
+static bool websocketAttached = false;
+
+struct TagLevel
+{
+    const char *tag;
+    uint8_t level;
+};
+static TagLevel tagLevels[LOG_MAX_TAG_LEVELS];
+static size_t tagLevelCount = 0;
+
+static const char levelLetters[] = "?EWIDT";
+
+static bool IRAM_ATTR reserve(uint32_t size, uint32_t &position)
+{
+#ifdef ESP32
+    position = __atomic_load_n(&reserveHead, __ATOMIC_RELAXED);
+    do
+    {
+        if (position + size - __atomic_load_n(&readTail, __ATOMIC_ACQUIRE) > LOG_RING_SIZE)
+        {
+            __atomic_fetch_add(&droppedLines, 1, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&reserveHead, &position, position + size, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return true;
+#elif defined(ESP8266)
+    // Single core: masking interrupts for a few instructions is the compare-and-swap
+    uint32_t savedPs = xt_rsil(15);
+    bool reserved = reserveHead + size - readTail <= LOG_RING_SIZE;
+    if (reserved)
+    {
+        position = reserveHead;
+        reserveHead += size;
+    }
+    else
+    {
+        droppedLines++;
+    }
+    xt_wsr_ps(savedPs);
+    return reserved;
+#endif
+}
+
+static void IRAM_ATTR copyToRing(uint32_t position, const void *data, size_t length, bool progmem)
+{
+    size_t offset = position % LOG_RING_SIZE;
+    size_t first = std::min(length, LOG_RING_SIZE - offset);
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    if (progmem)
+    {
+        memcpy_P(ring + offset, bytes, first);
+        memcpy_P(ring, bytes + first, length - first);
+    }
+    else
+    {
+        memcpy(ring + offset, bytes, first);
+        memcpy(ring, bytes + first, length - first);
+    }
+}
+
+// Queues prefix + message (+ '\n'), truncating the message to fit in LOG_MAX_LINE_LENGTH
+static void IRAM_ATTR pushRecord(uint8_t sinks, const uint8_t *prefix, size_t prefixLength,
+                                 const char *message, size_t length, bool progmem, bool newline)
+{
+    length = std::min<size_t>(length, LOG_MAX_LINE_LENGTH - prefixLength - (newline ? 1 : 0));
+    size_t recordLength = prefixLength + length + (newline ? 1 : 0);
+    uint32_t position;
+    if (!reserve(LOG_RECORD_HEADER_SIZE + ((recordLength + 3) & ~3u), position))
+        return;
+
+    uint32_t offset = position + LOG_RECORD_HEADER_SIZE;
+    copyToRing(offset, prefix, prefixLength, false);
+    copyToRing(offset + prefixLength, message, length, progmem);
+    if (newline)
+        ring[(offset + prefixLength + length) % LOG_RING_SIZE] = '\n';
+
+    __atomic_store_n(&ringWords[position % LOG_RING_SIZE / 4], LOG_RECORD_COMMITTED | sinks << LOG_RECORD_SINKS_SHIFT | recordLength, __ATOMIC_RELEASE);
+}
+
+static void IRAM_ATTR writeBinaryHeader(uint8_t *header, uint8_t level, uint32_t id, uint16_t payloadLength)
+{
+    uint32_t now = millis();
+    header[0] = LOG_BINARY_RECORD_START;
+    header[1] = level;
+    memcpy(header + 2, &id, 4);
+    memcpy(header + 6, &now, 4);
+    memcpy(header + 10, &payloadLength, 2);
+}
+
+static void IRAM_ATTR pushText(uint8_t sinks, const char *message, size_t length, bool progmem, bool newline)
+{
+#ifdef LOG_BINARY
+    uint8_t header[LOG_BINARY_HEADER_SIZE];
+    length = std::min<size_t>(length, LOG_MAX_LINE_LENGTH - LOG_BINARY_HEADER_SIZE - (newline ? 1 : 0));
+    writeBinaryHeader(header, LOG_LEVEL_NONE, 0, length + (newline ? 1 : 0));
+    pushRecord(sinks, header, sizeof(header), message, length, progmem, newline);
+#else
+    pushRecord(sinks, nullptr, 0, message, length, progmem, newline);
+#endif
+}
+
+void logPushBinary(uint8_t sinks, uint8_t level, uint32_t id, const uint8_t *args, size_t length)
+{
+    uint8_t header[LOG_BINARY_HEADER_SIZE];
+    writeBinaryHeader(header, level, id, length);
+    pushRecord(sinks, header, sizeof(header), reinterpret_cast<const char *>(args), length, false, false);
+}
+
+size_t writeLogDropMarker(char *marker, uint32_t dropped)
+{
+    size_t length = 0;
+#ifdef LOG_BINARY
+    length = LOG_BINARY_HEADER_SIZE;
+#endif
+    length += snprintf(marker + length, LOG_DROP_MARKER_SIZE - length, "[log] %u lines dropped\n", dropped);
+#ifdef LOG_BINARY
+    writeBinaryHeader(reinterpret_cast<uint8_t *>(marker), LOG_LEVEL_NONE, 0, length - LOG_BINARY_HEADER_SIZE);
+#endif
+    return length;
+}
+
+size_t logEntryLength(const char *data, size_t length)
+{
+#ifdef LOG_BINARY
+    uint16_t payloadLength;
+    if (length < LOG_BINARY_HEADER_SIZE)
+        return length;
+    memcpy(&payloadLength, data + 10, 2);
+    return std::min<size_t>(length, LOG_BINARY_HEADER_SIZE + payloadLength);
+#else
+    const char *end = static_cast<const char *>(memchr(data, '\n', length));
+    return end ? end - data + 1 : length;
+#endif
+}
+
+static void flushBatch(LogBatch &batch)
+{
+    if (batch.length == 0)
+        return;
+    writeLogUart(batch.data, batch.length);
+    batch.length = 0;
+}
+
+// Returns where to copy length more bytes, flushing the batch first if they don't fit
+static char *batchSpace(LogBatch &batch, size_t length)
+{
+    if (batch.length + length > LOG_BATCH_SIZE)
+        flushBatch(batch);
+    char *space = batch.data + batch.length;
+    batch.length += length;
+    return space;
+}
+
+void drainLogs()
+{
+    uint32_t tail = readTail;
+    while (true)
+    {
+        // Stop at the first record not committed yet, even if later ones are
+        uint32_t header = __atomic_load_n(&ringWords[tail % LOG_RING_SIZE / 4], __ATOMIC_ACQUIRE);
+        if (!(header & LOG_RECORD_COMMITTED))
+            break;
+        size_t length = header & LOG_RECORD_LENGTH_MASK;
+        uint8_t sinks = header >> LOG_RECORD_SINKS_SHIFT;
+        uint32_t recordSize = LOG_RECORD_HEADER_SIZE + ((length + 3) & ~3u);
+
+        size_t offset = (tail + LOG_RECORD_HEADER_SIZE) % LOG_RING_SIZE;
+        size_t first = std::min(length, LOG_RING_SIZE - offset);
+        if (sinks & LOG_SINK_SERIAL)
+        {
+            char *space = batchSpace(serialBatch, length);
+            memcpy(space, ring + offset, first);
+            memcpy(space + first, ring, length - first);
+        }
+        // Appended to the history first: a client replaying it from meanwhile skips the live copy
+        uint32_t seq = appendLogHistory(ring + offset, first, ring, length - first);
+        if ((sinks & LOG_SINK_WEBSOCKET) && websocketAttached)
+            queueLogClients(seq, ring + offset, first, ring, length - first);
+
+        // Zero the record, so that its bytes can't pass for a committed header once reused
+        for (uint32_t i = 0; i < recordSize; i += 4)
+            ringWords[(tail + i) % LOG_RING_SIZE / 4] = 0;
+        tail += recordSize;
+        __atomic_store_n(&readTail, tail, __ATOMIC_RELEASE);
+    }
+
+    uint32_t dropped = __atomic_load_n(&droppedLines, __ATOMIC_RELAXED);
+    if (dropped != reportedDroppedLines)
+    {
+        char marker[LOG_DROP_MARKER_SIZE];
+        size_t markerLength = writeLogDropMarker(marker, dropped - reportedDroppedLines);
+        memcpy(batchSpace(serialBatch, markerLength), marker, markerLength);
+        uint32_t seq = appendLogHistory(reinterpret_cast<uint8_t *>(marker), markerLength);
+        if (websocketAttached)
+            queueLogClients(seq, reinterpret_cast<uint8_t *>(marker), markerLength);
+        reportedDroppedLines = dropped;
+    }
+    flushBatch(serialBatch);
+    pumpLogUart();
+    sendLogClients();
+}
+
+#ifdef ESP32
+static void logDrainTask(void *)
+{
+    while (true)
+    {
+        drainLogs();
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+}
+#endif
+
+void beginLogPipeline()
+{
+    beginLogHistory();
+#ifdef ESP32
+    xTaskCreate(logDrainTask, "log_drain", 4096, nullptr, 1, nullptr);
+#endif
+}
+
+uint32_t getDroppedLogLines()
+{
+    return __atomic_load_n(&droppedLines, __ATOMIC_RELAXED);
+}
+
+void setLogSinkLevel(uint8_t sink, uint8_t level)
+{
+    if (sink & LOG_SINK_SERIAL)
+        sinkLevels[0] = level;
+    if (sink & LOG_SINK_WEBSOCKET)
+        sinkLevels[1] = level;
+}
+
+bool setLogTagLevel(const char *tag, uint8_t level)
+{
+    for (size_t i = 0; i < tagLevelCount; i++)
+    {
+        if (strcmp(tagLevels[i].tag, tag) == 0)
+        {
+            tagLevels[i].level = level;
+            return true;
+        }
+    }
+    if (tagLevelCount >= LOG_MAX_TAG_LEVELS)
+        return false;
+    tagLevels[tagLevelCount] = {tag, level};
+    tagLevelCount++;
+    return true;
+}
+
+void setLogWebsocketAttached(bool attached)
+{
+    websocketAttached = attached;
+}
+
+uint8_t IRAM_ATTR logSinksFor(uint8_t level, const char *tag)
+{
+    if (tag != nullptr)
+    {
+        for (size_t i = 0; i < tagLevelCount; i++)
+        {
+            if (tagLevels[i].tag == tag || strcmp(tagLevels[i].tag, tag) == 0)
+            {
+                if (level > tagLevels[i].level)
+                    return 0;
+                break;
+            }
+        }
+    }
+    uint8_t sinks = 0;
+    if (level <= sinkLevels[0])
+        sinks |= LOG_SINK_SERIAL;
+    if (websocketAttached && level <= sinkLevels[1])
+        sinks |= LOG_SINK_WEBSOCKET;
+    return sinks;
+}
+
+void logPrintf(uint8_t sinks, uint8_t level, const char *tag, const char *format, ...)
+{
+    char line[LOG_MAX_LINE_LENGTH];
+    int length = snprintf(line, sizeof(line), "%c [%s] ", levelLetters[level < sizeof(levelLetters) - 1 ? level : 0], tag);
+    va_list args;
+    va_start(args, format);
+    int messageLength = vsnprintf_P(line + length, sizeof(line) - length, format, args);
+    va_end(args);
+    if (messageLength < 0)
+        return;
+    pushText(sinks, line, std::min<size_t>(length + messageLength, sizeof(line) - 1), false, true);
+}
+
+void IRAM_ATTR logPrint(uint8_t sinks, const char *message)
+{
+    pushText(sinks, message, strlen(message), false, false);
+}
+
+void IRAM_ATTR logPrint(uint8_t sinks, const __FlashStringHelper *message)
+{
+    const char *p = reinterpret_cast<const char *>(message);
+    pushText(sinks, p, strlen_P(p), true, false);
+}
+
+void logPrint(uint8_t sinks, const String &message)
+{
+    pushText(sinks, message.c_str(), message.length(), false, false);
+}
+
+void IRAM_ATTR logPrintln(uint8_t sinks, const char *message)
+{
+    pushText(sinks, message, strlen(message), false, true);
+}
+
+void IRAM_ATTR logPrintln(uint8_t sinks, const __FlashStringHelper *message)
+{
+    const char *p = reinterpret_cast<const char *>(message);
+    pushText(sinks, p, strlen_P(p), true, true);
+}
+
+void logPrintln(uint8_t sinks, const String &message)
+{
+    pushText(sinks, message.c_str(), message.length(), false, true);
+}
@@ -0,0 +1,69 @@
+#ifndef LOG_PIPELINE_H
+#define LOG_PIPELINE_H
+
+#include <Arduino.h>
+
+#include "common/log_binary.h"
+
+#define LOG_RING_SIZE 4096     // bytes, power of 2
+#define LOG_MAX_LINE_LENGTH 512 // longer lines are truncated
+#define LOG_BATCH_SIZE 1024     // bytes per UART write
+#define LOG_DRAIN_INTERVAL_MS 20
+
+/**
+ * LOG_PRINT/LOG_PRINTLN don't write to Serial or to the logs websocket themselves: they copy the
+ * line into a lock-free ring, and return. Producers reserve room with a compare-and-swap on the
+ * write position and publish the record once copied, so logging is safe from any task and from
+ * ISRs (with a const char * or F() string), and never waits on the UART or the network.
+ *
+ * Each line carries the sinks it is meant for. The ring is drained by the log_drain task on ESP32,
+ * and by commonLoop on ESP8266: queued lines are batched into the UART ring (see log_uart.h),
+ * appended to the history (see log_history.h) and queued to each logs websocket client (see
+ * log_clients.h). When the ring is full, lines are dropped and counted; the count is logged with
+ * the next batch.
+ */
+#define LOG_SINK_SERIAL 0x1
+#define LOG_SINK_WEBSOCKET 0x2
+#define LOG_MAX_TAG_LEVELS 8
+
+void beginLogPipeline();
+void drainLogs();
+uint32_t getDroppedLogLines();
+
+// Writes the "[log] N lines dropped" line (a binary record with LOG_BINARY), returns its length
+#define LOG_DROP_MARKER_SIZE (LOG_BINARY_HEADER_SIZE + 48)
+size_t writeLogDropMarker(char *marker, uint32_t dropped);
+
+// Length of the first line (binary record with LOG_BINARY) in data
+size_t logEntryLength(const char *data, size_t length);
+
+// Runtime filters, on top of the compile time LOG_LEVEL
+void setLogSinkLevel(uint8_t sink, uint8_t level);
+bool setLogTagLevel(const char *tag, uint8_t level);
+void setLogWebsocketAttached(bool attached);
+
+// The sinks that want a message of this level and tag (nullptr for untagged messages), 0 if none
+uint8_t logSinksFor(uint8_t level, const char *tag);
+
+void logPrintf(uint8_t sinks, uint8_t level, const char *tag, const char *format, ...) __attribute__((format(printf, 4, 5)));
+
+void logPrint(uint8_t sinks, const char *message);
+void logPrint(uint8_t sinks, const __FlashStringHelper *message);
+void logPrint(uint8_t sinks, const String &message);
+void logPrintln(uint8_t sinks, const char *message);
+void logPrintln(uint8_t sinks, const __FlashStringHelper *message);
+void logPrintln(uint8_t sinks, const String &message);
+
+template <typename T>
+void logPrint(uint8_t sinks, const T &value)
+{
+    logPrint(sinks, String(value));
+}
+
+template <typename T>
+void logPrintln(uint8_t sinks, const T &value)
+{
+    logPrintln(sinks, String(value));
+}
+
+#endif // LOG_PIPELINE_H
@@ -0,0 +1,205 @@
+#include "common/log_uart.h"
+
+#ifdef ESP32
+#include <driver/uart.h>
+#elif defined(ESP8266)
+#include <uart.h>
+#endif
+
+#include "common/globals.h"
+
+static_assert((LOG_UART_BUFFER_SIZE & (LOG_UART_BUFFER_SIZE - 1)) == 0, "LOG_UART_BUFFER_SIZE must be a power of 2");
+static_assert(LOG_UART_BUFFER_SIZE >= LOG_BATCH_SIZE, "a batch must fit in the UART ring");
+
+// Positions are free-running, taken modulo LOG_UART_BUFFER_SIZE. Only the log drain writes and pumps.
+static char uartRing[LOG_UART_BUFFER_SIZE];
+static uint32_t uartHead = 0;
+static uint32_t uartTail = 0;
+static uint32_t uartEntryStart = 0; // start of the line being sent, kept until it's sent in full
+static bool uartMidLine = false;     // the last byte sent wasn't a newline
+static LogUartOverflow uartOverflow = LOG_UART_OVERFLOW;
+static uint32_t uartDroppedLines = 0;
+static uint32_t uartUnreportedDroppedLines = 0;
+
+// Set by pauseLogUart (loop task), checked by the pump (log drain task on ESP32)
+static bool uartPaused = false;
+static bool uartWriting = false;
+
+void beginLogUart(unsigned long baud)
+{
+#ifdef ESP32
+    Serial.setTxBufferSize(LOG_UART_DRIVER_BUFFER_SIZE); // must come before begin()
+#endif
+    Serial.begin(baud);
+}
+
+static size_t uartFree()
+{
+    return LOG_UART_BUFFER_SIZE - (uartHead - uartEntryStart);
+}
+
+static void copyToUartRing(const char *data, size_t length)
+{
+    size_t offset = uartHead % LOG_UART_BUFFER_SIZE;
+    size_t first = std::min(length, LOG_UART_BUFFER_SIZE - offset);
+    memcpy(uartRing + offset, data, first);
+    memcpy(uartRing, data + first, length - first);
+    uartHead += length;
+}
+
+// Length of the line (binary record with LOG_BINARY) starting at position
+static size_t entryLengthAt(uint32_t position)
+{
+    size_t available = uartHead - position;
+#ifdef LOG_BINARY
+    char header[LOG_BINARY_HEADER_SIZE];
+    if (available < sizeof(header))
+        return available;
+    for (size_t i = 0; i < sizeof(header); i++)
+        header[i] = uartRing[(position + i) % LOG_UART_BUFFER_SIZE];
+    return logEntryLength(header, available);
+#else
+    for (size_t i = 0; i < available; i++)
+    {
+        if (uartRing[(position + i) % LOG_UART_BUFFER_SIZE] == '\n')
+            return i + 1;
+    }
+    return available;
+#endif
+}
+
+// Moves uartEntryStart up to the line being sent, so that the pump can stop halfway through a line
+static void skipSentEntries()
+{
+    while (uartEntryStart != uartTail)
+    {
+        size_t length = entryLengthAt(uartEntryStart);
+        if (uartTail - uartEntryStart < length)
+            break;
+        uartEntryStart += length;
+    }
+}
+
+// Makes room for length bytes according to the overflow policy, returns false if there's none
+static bool makeRoom(size_t length)
+{
+    switch (uartOverflow)
+    {
+    case LOG_UART_DROP_OLDEST:
+    {
+        if (uartFree() >= length)
+            return true;
+#ifdef LOG_BINARY
+        bool cutShort = false;
+#else
+        // A line cut short once partly sent still ends with a newline: the one of the last line dropped
+        bool cutShort = uartMidLine;
+#endif
+        while (uartFree() < length + (cutShort ? 1 : 0))
+        {
+            size_t entry = entryLengthAt(uartEntryStart);
+            uartEntryStart += entry;
+            if (!cutShort || entry > 1) // not the newline kept for an earlier cut
+            {
+                uartDroppedLines++;
+                uartUnreportedDroppedLines++;
+            }
+        }
+        if (cutShort && uartRing[(uartEntryStart - 1) % LOG_UART_BUFFER_SIZE] == '\n')
+            uartEntryStart--;
+        uartTail = uartEntryStart;
+        return true;
+    }
+    case LOG_UART_BLOCK:
+        while (uartFree() < length)
+        {
+            pumpLogUart();
+            if (uartFree() < length)
+                delay(1);
+        }
+        return true;
+    default:
+        return uartFree() >= length;
+    }
+}
+
+void writeLogUart(const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        size_t entry = logEntryLength(data, length);
+        bool reportDrops = uartUnreportedDroppedLines > 0 && makeRoom(entry + LOG_DROP_MARKER_SIZE);
+        if (reportDrops)
+        {
+            char marker[LOG_DROP_MARKER_SIZE];
+            copyToUartRing(marker, writeLogDropMarker(marker, uartUnreportedDroppedLines));
+            uartUnreportedDroppedLines = 0;
+        }
+        if (reportDrops || makeRoom(entry))
+        {
+            copyToUartRing(data, entry);
+        }
+        else
+        {
+            uartDroppedLines++;
+            uartUnreportedDroppedLines++;
+        }
+        data += entry;
+        length -= entry;
+    }
+    pumpLogUart();
+}
+
+void pumpLogUart()
+{
+    __atomic_store_n(&uartWriting, true, __ATOMIC_SEQ_CST);
+    while (uartHead != uartTail && !__atomic_load_n(&uartPaused, __ATOMIC_SEQ_CST))
+    {
+        size_t offset = uartTail % LOG_UART_BUFFER_SIZE;
+        size_t length = std::min<size_t>(uartHead - uartTail, LOG_UART_BUFFER_SIZE - offset);
+        length = std::min<size_t>(length, Serial.availableForWrite());
+        if (length == 0)
+            break;
+        size_t written = Serial.write(reinterpret_cast<const uint8_t *>(uartRing + offset), length);
+        uartTail += written;
+        if (written > 0)
+            uartMidLine = uartRing[(uartTail - 1) % LOG_UART_BUFFER_SIZE] != '\n';
+    }
+    skipSentEntries();
+    __atomic_store_n(&uartWriting, false, __ATOMIC_SEQ_CST);
+}
+
+void setLogUartOverflow(LogUartOverflow overflow)
+{
+    uartOverflow = overflow;
+}
+
+uint32_t getLogUartDroppedLines()
+{
+    return uartDroppedLines;
+}
+
+static bool uartIdle()
+{
+#ifdef ESP32
+    return uart_wait_tx_done(UART_NUM_0, 0) == ESP_OK;
+#elif defined(ESP8266)
+    return Serial.availableForWrite() >= UART_TX_FIFO_SIZE;
+#endif
+}
+
+bool pauseLogUart()
+{
+    __atomic_store_n(&uartPaused, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&uartWriting, __ATOMIC_SEQ_CST) || !uartIdle())
+    {
+        resumeLogUart();
+        return false;
+    }
+    return true;
+}
+
+void resumeLogUart()
+{
+    __atomic_store_n(&uartPaused, false, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,44 @@
+#ifndef LOG_UART_H
+#define LOG_UART_H
+
+#include <Arduino.h>
+
+#ifdef ESP32
+#define LOG_UART_BUFFER_SIZE 4096       // bytes, power of 2
+#define LOG_UART_DRIVER_BUFFER_SIZE 1024 // UART driver TX buffer, sent by its interrupt between drains
+#elif defined(ESP8266)
+#define LOG_UART_BUFFER_SIZE 2048
+#endif
+
+enum LogUartOverflow : uint8_t
+{
+    LOG_UART_DROP_NEWEST, // lines that don't fit are dropped
+    LOG_UART_DROP_OLDEST, // the oldest lines not sent yet make room
+    LOG_UART_BLOCK        // the log drain waits for room, nothing is lost
+};
+#ifndef LOG_UART_OVERFLOW
+#define LOG_UART_OVERFLOW LOG_UART_DROP_NEWEST // or set at runtime with setLogUartOverflow()
+#endif
+
+/**
+ * Log lines meant for Serial are copied into a ring and moved into the UART as it has room,
+ * by the log drain: nobody waits on the UART at 115200 baud. On ESP32 the UART driver has its own
+ * TX buffer, emptied by its interrupt; on ESP8266 the ring is moved into the 128 byte FIFO on
+ * each drain, i.e. each commonLoop. When the ring is full, the overflow policy decides which
+ * lines are dropped; they are counted, and a "N lines dropped" line is written once there's room.
+ *
+ * The TX pin doubles as the LED pin on some boards: pauseLogUart() holds the output back while
+ * the pin is used for something else.
+ */
+void beginLogUart(unsigned long baud);
+void writeLogUart(const char *data, size_t length); // whole lines
+void pumpLogUart();
+
+void setLogUartOverflow(LogUartOverflow overflow);
+uint32_t getLogUartDroppedLines();
+
+// Returns true once the UART is idle and paused, false (not paused) while it is still sending
+bool pauseLogUart();
+void resumeLogUart();
+
+#endif // LOG_UART_H
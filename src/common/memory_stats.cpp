@@ -1,13 +1,172 @@
 #include "common/memory_stats.h"
-#include "common/globals.h"
 
 MemoryStats ramStats;
 uint64_t memStatsLastUpdatedMillis = 0;
 
+void MemoryStats::addSample(uint32_t sample, uint8_t heapFragmentation_, uint32_t maxFreeBlockSize_)
+{
+    static_assert(sampleSize % MEMORY_STATS_BLOCK_SIZE == 0, "sampleSize must be made of whole blocks");
+
+    uint16_t quantized = std::min<uint32_t>((sample + MEMORY_STATS_QUANTUM / 2) / MEMORY_STATS_QUANTUM, UINT16_MAX);
+    if (currentSampleIndex % MEMORY_STATS_BLOCK_SIZE == 0)
+    {
+        oldFrame = frames[currentSampleIndex / MEMORY_STATS_BLOCK_SIZE];
+        headFill = 0;
+    }
+
+    if (isBufferFull)
+        sampleSum -= decode(oldFrame, currentSampleIndex);
+    sampleSum += encode(quantized);
+    headFill++;
+
+    currentSampleIndex = (currentSampleIndex + 1) % sampleSize;
+    if (currentSampleIndex == 0)
+        isBufferFull = true;
+    heapFragmentation = heapFragmentation_;
+    maxFreeBlockSize = maxFreeBlockSize_;
+
+    addRollupSample(sample);
+}
+
+uint8_t MemoryStats::readOffset(size_t index) const
+{
+    size_t bit = index * MEMORY_STATS_SAMPLE_BITS;
+    uint16_t bits = packedSamples[bit / 8];
+    if (bit % 8 + MEMORY_STATS_SAMPLE_BITS > 8)
+        bits |= packedSamples[bit / 8 + 1] << 8;
+    return (bits >> (bit % 8)) & MEMORY_STATS_MAX_OFFSET;
+}
+
+void MemoryStats::writeOffset(size_t index, uint8_t offset)
+{
+    size_t bit = index * MEMORY_STATS_SAMPLE_BITS;
+    uint16_t mask = MEMORY_STATS_MAX_OFFSET << (bit % 8);
+    uint16_t bits = offset << (bit % 8);
+    packedSamples[bit / 8] = (packedSamples[bit / 8] & ~mask) | bits;
+    if (bit % 8 + MEMORY_STATS_SAMPLE_BITS > 8)
+        packedSamples[bit / 8 + 1] = (packedSamples[bit / 8 + 1] & ~(mask >> 8)) | (bits >> 8);
+}
+
+// Writes value as the next sample of the block being written, returns its decoded value
+uint16_t MemoryStats::encode(uint16_t value)
+{
+    MemoryBlockFrame &frame = frames[currentSampleIndex / MEMORY_STATS_BLOCK_SIZE];
+    if (headFill == 0)
+        frame = {value, 0, 0};
+    else if (value < frame.base || (value - frame.base + (1 << frame.shift >> 1)) >> frame.shift > MEMORY_STATS_MAX_OFFSET)
+        reframe(value);
+
+    uint8_t offset = (value - frame.base + (1 << frame.shift >> 1)) >> frame.shift;
+    writeOffset(currentSampleIndex, offset);
+    frame.maxOffset = std::max(frame.maxOffset, offset);
+    return frame.base + (offset << frame.shift);
+}
+
+// Moves the samples written so far in the block to a frame that value fits in
+void MemoryStats::reframe(uint16_t value)
+{
+    MemoryBlockFrame &frame = frames[currentSampleIndex / MEMORY_STATS_BLOCK_SIZE];
+    size_t start = currentSampleIndex - headFill;
+    int32_t low = std::min(frame.base, value);
+    int32_t high = std::max<int32_t>(frame.base + (frame.maxOffset << frame.shift), value);
+
+    MemoryBlockFrame next = {0, frame.shift, 0};
+    while (true)
+    {
+        // On the current grid, so that samples only get rounded when the shift grows
+        int32_t step = 1 << next.shift;
+        int32_t base = frame.base - (frame.base - low + step - 1) / step * step;
+        next.base = std::max<int32_t>(base, 0);
+        if (high - next.base <= MEMORY_STATS_MAX_OFFSET << next.shift)
+            break;
+        next.shift++;
+    }
+
+    for (size_t i = start; i < currentSampleIndex; i++)
+    {
+        uint16_t old = decode(frame, i);
+        uint8_t offset = (old - next.base + (1 << next.shift >> 1)) >> next.shift;
+        writeOffset(i, offset);
+        next.maxOffset = std::max(next.maxOffset, offset);
+        sampleSum += (next.base + (offset << next.shift)) - old;
+    }
+    frame = next;
+}
+
+uint32_t MemoryStats::getMin() const
+{
+    if (!isBufferFull && currentSampleIndex == 0)
+        return 0;
+    size_t head = currentSampleIndex / MEMORY_STATS_BLOCK_SIZE;
+    if (headFill == MEMORY_STATS_BLOCK_SIZE)
+        head = (head + blockCount - 1) % blockCount; // the block just completed
+    uint16_t min = UINT16_MAX;
+    for (size_t block = 0; block < blockCount; block++)
+    {
+        if (block != head ? isBufferFull || block < head : headFill > 0)
+            min = std::min(min, frames[block].base);
+    }
+    if (isBufferFull)
+    {
+        for (size_t i = headFill; i < MEMORY_STATS_BLOCK_SIZE; i++)
+            min = std::min(min, decode(oldFrame, head * MEMORY_STATS_BLOCK_SIZE + i));
+    }
+    return min * MEMORY_STATS_QUANTUM;
+}
+
+uint32_t MemoryStats::getMax() const
+{
+    if (!isBufferFull && currentSampleIndex == 0)
+        return 0;
+    size_t head = currentSampleIndex / MEMORY_STATS_BLOCK_SIZE;
+    if (headFill == MEMORY_STATS_BLOCK_SIZE)
+        head = (head + blockCount - 1) % blockCount;
+    uint16_t max = 0;
+    for (size_t block = 0; block < blockCount; block++)
+    {
+        const MemoryBlockFrame &frame = frames[block];
+        if (block != head ? isBufferFull || block < head : headFill > 0)
+            max = std::max<uint16_t>(max, frame.base + (frame.maxOffset << frame.shift));
+    }
+    if (isBufferFull)
+    {
+        for (size_t i = headFill; i < MEMORY_STATS_BLOCK_SIZE; i++)
+            max = std::max(max, decode(oldFrame, head * MEMORY_STATS_BLOCK_SIZE + i));
+    }
+    return max * MEMORY_STATS_QUANTUM;
+}
+
+double MemoryStats::getAverage() const
+{
+    size_t count = isBufferFull ? sampleSize : currentSampleIndex;
+    if (count == 0)
+        return 0;
+    return static_cast<double>(sampleSum) * MEMORY_STATS_QUANTUM / count;
+}
+
+void MemoryStats::addRollupSample(uint32_t sample)
+{
+    uint32_t now = millis();
+    if (minuteRollups.openSamples > 0 && now - minuteStartMillis >= 60 * 1000)
+    {
+        minuteRollups.close(hourRollups);
+        if (hourRollups.openBuckets == 60)
+        {
+            hourRollups.close(dayRollups);
+            if (dayRollups.openBuckets == 24)
+                dayRollups.close();
+        }
+    }
+    if (minuteRollups.openSamples == 0)
+        minuteStartMillis = now;
+    minuteRollups.merge(sample, sample, sample, 1);
+}
+
 void updateMemoryStats()
 {
     if (millis() - memStatsLastUpdatedMillis < ramStatsUpdateIntervalMillis)
         return;
+    memStatsLastUpdatedMillis = millis();
 #ifdef ESP32
     uint32_t freeHeap = esp_get_free_heap_size();
     ramStats.addSample(freeHeap);
@@ -3,62 +3,143 @@
 
 #include "Arduino.h"
 
-#include <vector>
-#include <numeric> // For std::accumulate
+#define MEMORY_STATS_BLOCK_SIZE 60
+#define MEMORY_STATS_QUANTUM 256
+#define MEMORY_STATS_SAMPLE_BITS 7
+#define MEMORY_STATS_MAX_OFFSET ((1 << MEMORY_STATS_SAMPLE_BITS) - 1)
 
-struct MemoryStats
+struct MemoryRollup
 {
-    std::vector<uint32_t> usageSamples;
-    size_t currentSampleIndex = 0;
-    bool isBufferFull = false;
-    const size_t sampleSize = 60 * 24; // 24h at 60 measurements /h
-    uint8_t heapFragmentation = 0;
-    uint32_t maxFreeBlockSize = 0;
+    uint32_t min;
+    uint32_t max;
+    uint32_t average;
+};
 
-    MemoryStats()
-    {
-        usageSamples.resize(sampleSize, 0);
-    }
+/**
+ * The last N rollups at one resolution (oldest dropped first), plus the bucket being filled.
+ */
+template <size_t N>
+struct MemoryRollupRing
+{
+    MemoryRollup rollups[N];
+    size_t next = 0;
+    size_t count = 0;
 
-    void addSample(uint32_t sample, uint8_t heapFragmentation_, uint32_t maxFreeBlockSize_)
+    uint32_t openMin = UINT32_MAX;
+    uint32_t openMax = 0;
+    uint64_t openSum = 0;
+    uint32_t openSamples = 0;
+    uint16_t openBuckets = 0; // buckets of the finer resolution merged into the open one
+
+    void merge(uint32_t min, uint32_t max, uint64_t sum, uint32_t samples)
     {
-        usageSamples[currentSampleIndex] = sample;
-        currentSampleIndex = (currentSampleIndex + 1) % sampleSize;
-        if (currentSampleIndex == 0)
-            isBufferFull = true;
-        heapFragmentation = heapFragmentation_;
-        maxFreeBlockSize = maxFreeBlockSize_;
+        openMin = std::min(openMin, min);
+        openMax = std::max(openMax, max);
+        openSum += sum;
+        openSamples += samples;
+        openBuckets++;
     }
 
-    void addSample(uint32_t sample)
+    // Closes the open bucket, passing its content on to the coarser resolution
+    template <size_t M>
+    void close(MemoryRollupRing<M> &coarser)
     {
-        addSample(sample, 0, 0);
+        if (openSamples > 0)
+            coarser.merge(openMin, openMax, openSum, openSamples);
+        close();
     }
 
-    uint32_t getMin() const
+    void close()
     {
-        auto begin = usageSamples.begin();
-        auto end = isBufferFull ? usageSamples.end() : begin + currentSampleIndex;
-        return *std::min_element(begin, end);
+        if (openSamples > 0)
+        {
+            rollups[next] = {openMin, openMax, static_cast<uint32_t>(openSum / openSamples)};
+            next = (next + 1) % N;
+            count = std::min(count + 1, N);
+        }
+        openMin = UINT32_MAX;
+        openMax = 0;
+        openSum = 0;
+        openSamples = 0;
+        openBuckets = 0;
     }
 
-    uint32_t getMax() const
+    size_t size() const { return count; }
+
+    // age 0 is the most recently closed bucket
+    const MemoryRollup &get(size_t age) const
     {
-        auto begin = usageSamples.begin();
-        auto end = isBufferFull ? usageSamples.end() : begin + currentSampleIndex;
-        return *std::max_element(begin, end);
+        return rollups[(next + N - 1 - age) % N];
     }
+};
+
+// Where the samples of a block are: their 7-bit offsets are base + (offset << shift), in quanta
+struct MemoryBlockFrame
+{
+    uint16_t base;      // the block's min
+    uint8_t shift;
+    uint8_t maxOffset;  // the block's max is base + (maxOffset << shift)
+};
 
-    double getAverage() const
+/**
+ * Free heap samples over a sliding window, with min/max/average readable in O(blocks), and
+ * rollups at 1 minute, 1 hour and 1 day resolution.
+ *
+ * Samples are stored in units of MEMORY_STATS_QUANTUM bytes, as 7-bit offsets packed back to back,
+ * in blocks of MEMORY_STATS_BLOCK_SIZE samples sharing a frame (base and shift). A block starts at
+ * shift 0; when a sample doesn't fit, the block's samples written so far are moved to a coarser
+ * frame, one bit at a time and on the same grid, so each shift rounds a sample once. A decoded
+ * sample is within (2^shift - 1/2) quanta of the real one: 128 bytes while the block spans less
+ * than 127 quanta (32 KB), 384 bytes up to 64 KB, and so on. The window's min/max/average are
+ * computed on decoded values.
+ *
+ * A block's frame gives its min and max, and the sum of the window is kept up to date, so reading
+ * them only decodes the old samples of the block being overwritten.
+ */
+struct MemoryStats
+{
+    static const size_t sampleSize = 60 * 24; // 24h at 60 measurements /h
+    size_t currentSampleIndex = 0;
+    bool isBufferFull = false;
+    uint8_t heapFragmentation = 0;
+    uint32_t maxFreeBlockSize = 0;
+
+    MemoryRollupRing<60> minuteRollups;
+    MemoryRollupRing<24> hourRollups;
+    MemoryRollupRing<30> dayRollups;
+
+    void addSample(uint32_t sample, uint8_t heapFragmentation_, uint32_t maxFreeBlockSize_);
+
+    void addSample(uint32_t sample)
     {
-        auto begin = usageSamples.begin();
-        auto end = isBufferFull ? usageSamples.end() : begin + currentSampleIndex;
-        double sum = std::accumulate(begin, end, 0.0);
-        size_t count = isBufferFull ? sampleSize : currentSampleIndex;
-        return sum / count;
+        addSample(sample, 0, 0);
     }
+
+    uint32_t getMin() const;
+    uint32_t getMax() const;
+    double getAverage() const;
+
+private:
+    static const size_t blockCount = sampleSize / MEMORY_STATS_BLOCK_SIZE;
+
+    uint8_t packedSamples[(sampleSize * MEMORY_STATS_SAMPLE_BITS + 7) / 8];
+    MemoryBlockFrame frames[blockCount];
+    MemoryBlockFrame oldFrame = {}; // of the samples not overwritten yet in the block being written
+    uint8_t headFill = 0;           // samples written in the block being written
+    uint32_t sampleSum = 0;
+    uint32_t minuteStartMillis = 0;
+
+    uint8_t readOffset(size_t index) const;
+    void writeOffset(size_t index, uint8_t offset);
+    uint16_t decode(const MemoryBlockFrame &frame, size_t index) const { return frame.base + (readOffset(index) << frame.shift); }
+    uint16_t encode(uint16_t value);
+    void reframe(uint16_t value);
+    void addRollupSample(uint32_t sample);
 };
 
+extern MemoryStats ramStats;
+extern uint64_t ramStatsUpdateIntervalMillis;
+
 void updateMemoryStats();
 
-#endif
\ No newline at end of file
+#endif
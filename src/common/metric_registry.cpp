@@ -0,0 +1,53 @@
+#include "common/metric_registry.h"
+
+#include <stdio.h>
+
+#include "common/log.h"
+
+static Metric metrics[METRICS_MAX_COUNT];
+static size_t metricCount = 0;
+
+static const char *const metricTypeNames[] = {"counter", "gauge"};
+
+#define METRIC_FORMAT "# HELP %s %s\n# TYPE %s %s\n%s %ld\n"
+
+bool registerMetric(const char *name, const char *help, MetricType type, MetricReader read)
+{
+    if (metricCount >= METRICS_MAX_COUNT)
+    {
+        LOG_E("metrics", "registry full, dropping %s", name);
+        return false;
+    }
+    // Rendered with the longest value, so that no scrape can cut it
+    int length = snprintf(nullptr, 0, METRIC_FORMAT, name, help, name, metricTypeNames[type], name, static_cast<long>(INT32_MIN));
+    if (length < 0 || length >= METRICS_BLOCK_SIZE)
+    {
+        LOG_E("metrics", "%s is longer than %d bytes, dropping it", name, METRICS_BLOCK_SIZE - 1);
+        return false;
+    }
+    metrics[metricCount++] = {name, help, type, read};
+    return true;
+}
+
+size_t getMetricCount()
+{
+    return metricCount;
+}
+
+const Metric *getMetric(size_t index)
+{
+    return index < metricCount ? &metrics[index] : nullptr;
+}
+
+size_t renderMetric(size_t index, char *buffer, size_t size)
+{
+    if (index >= metricCount || size == 0)
+        return 0;
+    const Metric &metric = metrics[index];
+    int length = snprintf(buffer, size, METRIC_FORMAT, metric.name, metric.help, metric.name,
+                          metricTypeNames[metric.type], metric.name, static_cast<long>(metric.read()));
+    // A cut line would run into the next metric's
+    if (length < 0 || static_cast<size_t>(length) >= size)
+        return 0;
+    return length;
+}
@@ -0,0 +1,44 @@
+#ifndef METRIC_REGISTRY_H
+#define METRIC_REGISTRY_H
+
+#include <Arduino.h>
+
+#define METRICS_COMMON_COUNT 29 // registered by registerCommonMetrics() on ESP8266, 27 on ESP32
+#ifndef METRICS_PROJECT_COUNT
+#define METRICS_PROJECT_COUNT 16 // left for the project's own, build with -DMETRICS_PROJECT_COUNT=n for more
+#endif
+#define METRICS_MAX_COUNT (METRICS_COMMON_COUNT + METRICS_PROJECT_COUNT)
+#define METRICS_BLOCK_SIZE 256 // HELP, TYPE and sample lines of one metric
+
+enum MetricType : uint8_t
+{
+    METRIC_COUNTER,
+    METRIC_GAUGE
+};
+
+typedef int32_t (*MetricReader)();
+
+struct Metric
+{
+    const char *name;
+    const char *help;
+    MetricType type;
+    MetricReader read;
+};
+
+/**
+ * Adds a metric to /metrics. name and help must outlive the registry (string literals),
+ * and read is called on every scrape. Returns false once METRICS_MAX_COUNT metrics are registered,
+ * or if the metric's lines could be longer than METRICS_BLOCK_SIZE.
+ *
+ *   registerMetric("app_relay_switches_total", "Relay switches since boot", METRIC_COUNTER,
+ *                  []() -> int32_t { return relaySwitches; });
+ */
+bool registerMetric(const char *name, const char *help, MetricType type, MetricReader read);
+size_t getMetricCount();
+const Metric *getMetric(size_t index); // nullptr past the last one
+
+// Writes the metric in Prometheus text format to buffer, and returns its length: 0 if it doesn't fit
+size_t renderMetric(size_t index, char *buffer, size_t size);
+
+#endif // METRIC_REGISTRY_H
@@ -0,0 +1,121 @@
+#include "common/metrics.h"
+
+#ifdef ESP32
+#include <WiFi.h>
+#elif defined(ESP8266)
+#include <ESP8266WiFi.h>
+#endif
+
+#include "common/admission.h"
+#include "common/globals.h"
+#include "common/json_arena.h"
+#include "common/log_clients.h"
+#include "common/log_uart.h"
+#include "common/response_cache.h"
+#include "common/utils.h"
+#include "common/wifi_handler.h"
+
+// Housekeeping duration, over the last full minute
+static uint32_t loopStartMicros = 0;
+static uint32_t loopIterations = 0;
+static uint32_t loopWindowStartMillis = 0;
+static uint32_t loopWindowMax = 0, loopWindowSum = 0, loopWindowCount = 0;
+static uint32_t loopLastMaxMicros = 0, loopLastAverageMicros = 0;
+
+void loopTimingStart()
+{
+    loopStartMicros = micros();
+}
+
+void loopTimingEnd()
+{
+    uint32_t duration = micros() - loopStartMicros;
+    loopIterations++;
+    loopWindowMax = std::max(loopWindowMax, duration);
+    loopWindowSum += duration;
+    loopWindowCount++;
+
+    if (millis() - loopWindowStartMillis >= 60 * 1000)
+    {
+        loopLastMaxMicros = loopWindowMax;
+        loopLastAverageMicros = loopWindowSum / loopWindowCount;
+        loopWindowStartMillis = millis();
+        loopWindowMax = loopWindowSum = loopWindowCount = 0;
+    }
+}
+
+void registerCommonMetrics()
+{
+    registerMetric("esp_uptime_seconds", "Seconds since boot", METRIC_COUNTER, []() -> int32_t
+                   { return getUptimeSeconds(); });
+    registerMetric("esp_heap_free_bytes", "Free heap", METRIC_GAUGE, []() -> int32_t
+                   { return ESP.getFreeHeap(); });
+    registerMetric("esp_heap_free_min_bytes", "Lowest free heap over the last 24h", METRIC_GAUGE, []() -> int32_t
+                   { return ramStats.getMin(); });
+    registerMetric("esp_heap_free_max_bytes", "Highest free heap over the last 24h", METRIC_GAUGE, []() -> int32_t
+                   { return ramStats.getMax(); });
+    registerMetric("esp_heap_free_average_bytes", "Average free heap over the last 24h", METRIC_GAUGE, []() -> int32_t
+                   { return ramStats.getAverage(); });
+#ifdef ESP8266
+    registerMetric("esp_heap_max_free_block_bytes", "Largest free heap block", METRIC_GAUGE, []() -> int32_t
+                   { return ramStats.maxFreeBlockSize; });
+    registerMetric("esp_heap_fragmentation_percent", "Heap fragmentation", METRIC_GAUGE, []() -> int32_t
+                   { return ramStats.heapFragmentation; });
+#endif
+    registerMetric("esp_wifi_rssi_dbm", "WiFi signal strength, 0 when not connected", METRIC_GAUGE, []() -> int32_t
+                   { return WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0; });
+    registerMetric("esp_wifi_connect_attempts_total", "WiFi connection attempts", METRIC_COUNTER, []() -> int32_t
+                   { return getWifiStats().attempts; });
+    registerMetric("esp_wifi_connect_failures_total", "WiFi connection attempts that timed out or were refused", METRIC_COUNTER, []() -> int32_t
+                   { return getWifiStats().failures; });
+    registerMetric("esp_wifi_connect_latency_ms", "Time to get an IP, in the last attempt that connected", METRIC_GAUGE, []() -> int32_t
+                   { return getWifiStats().lastConnectMillis; });
+    registerMetric("esp_quick_restarts", "Quick restarts counted at boot", METRIC_GAUGE, []() -> int32_t
+                   { return quickRestartsCount; });
+    registerMetric("esp_config_mode", "1 when running in config mode", METRIC_GAUGE, []() -> int32_t
+                   { return configMode ? 1 : 0; });
+    registerMetric("esp_ota_checks_total", "Checks for new firmware on github", METRIC_COUNTER, []() -> int32_t
+                   { return updater ? updater->stats.checks : 0; });
+    registerMetric("esp_ota_check_errors_total", "Checks for new firmware that got no valid release", METRIC_COUNTER, []() -> int32_t
+                   { return updater ? updater->stats.checkErrors : 0; });
+    registerMetric("esp_ota_update_failures_total", "Firmware downloads or flashes that failed", METRIC_COUNTER, []() -> int32_t
+                   { return updater ? updater->stats.updateFailures : 0; });
+    registerMetric("esp_ws_log_clients", "Clients connected to the logs websocket", METRIC_GAUGE, []() -> int32_t
+                   { return wsLogs.count(); });
+    registerMetric("esp_log_dropped_lines_total", "Log lines dropped because the log ring was full", METRIC_COUNTER, []() -> int32_t
+                   { return getDroppedLogLines(); });
+    registerMetric("esp_log_uart_dropped_lines_total", "Log lines dropped because the UART ring was full", METRIC_COUNTER, []() -> int32_t
+                   { return getLogUartDroppedLines(); });
+    registerMetric("esp_ws_log_client_dropped_lines_total", "Log lines dropped because a logs websocket client couldn't keep up", METRIC_COUNTER, []() -> int32_t
+                   { return getLogClientDroppedLines(); });
+    registerMetric("esp_http_in_flight", "Requests being answered", METRIC_GAUGE, []() -> int32_t
+                   { return getAdmissionInFlight(); });
+    registerMetric("esp_http_rate_limited_total", "Requests turned down with a 429, their client was over its rate", METRIC_COUNTER, []() -> int32_t
+                   { return getAdmissionRejected(ADMISSION_RATE_LIMITED); });
+    registerMetric("esp_http_busy_total", "Requests turned down with a 503, too many in flight or too little heap", METRIC_COUNTER, []() -> int32_t
+                   { return getAdmissionRejected(ADMISSION_BUSY); });
+    registerMetric("esp_http_cache_hits_total", "Responses sent from the response cache", METRIC_COUNTER, []() -> int32_t
+                   { return getResponseCacheHits(); });
+    registerMetric("esp_http_cache_misses_total", "Responses rendered again for the response cache", METRIC_COUNTER, []() -> int32_t
+                   { return getResponseCacheMisses(); });
+    registerMetric("esp_json_arena_peak_bytes", "Most of the JSON arena used by an /api response", METRIC_GAUGE, []() -> int32_t
+                   { return getJsonArenaPeakBytes(); });
+    registerMetric("esp_loop_iterations_total", "Housekeeping loop iterations", METRIC_COUNTER, []() -> int32_t
+                   { return loopIterations; });
+    registerMetric("esp_loop_max_microseconds", "Longest housekeeping loop iteration over the last full minute", METRIC_GAUGE, []() -> int32_t
+                   { return loopLastMaxMicros; });
+    registerMetric("esp_loop_average_microseconds", "Average housekeeping loop iteration over the last full minute", METRIC_GAUGE, []() -> int32_t
+                   { return loopLastAverageMicros; });
+}
+
+size_t MetricsResponse::renderNext(char *block, size_t size)
+{
+    // Past the ones that don't fit, renderMetric returns 0 for them
+    while (nextMetric < getMetricCount())
+    {
+        size_t length = renderMetric(nextMetric++, block, size);
+        if (length > 0)
+            return length;
+    }
+    return 0;
+}
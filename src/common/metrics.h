@@ -0,0 +1,29 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "common/block_response.h"
+#include "common/metric_registry.h"
+
+void registerCommonMetrics();
+
+// Called at the start and end of commonLoop, to time the housekeeping
+void loopTimingStart();
+void loopTimingEnd();
+
+// Streams the registered metrics, one at a time
+class MetricsResponse : public BlockResponse<METRICS_BLOCK_SIZE>
+{
+public:
+    explicit MetricsResponse(bool chunked) : BlockResponse("text/plain; version=0.0.4", chunked) {}
+
+protected:
+    size_t renderNext(char *block, size_t size) override;
+
+private:
+    size_t nextMetric = 0;
+};
+
+#endif // METRICS_H
@@ -1,5 +1,11 @@
 #include "ota_handler.h"
 
+#include "common/globals.h"
+#include "common/heap_trace.h"
+#include "common/job_queue.h"
+#include "common/route_registry.h"
+#include "common/web_assets.h"
+
 #include <ArduinoJson.h>
 
 #ifdef ESP32
@@ -14,23 +20,6 @@
 #include <ESP8266WiFi.h>
 #endif
 
-#ifndef DEBUG_PRINT
-#define DEBUG
-#ifdef DEBUG
-#define DEBUG_PRINT(str)   \
-    {                      \
-        Serial.print(str); \
-    }
-#define DEBUG_PRINTLN(str)   \
-    {                        \
-        Serial.println(str); \
-    }
-#else
-#define DEBUG_PRINT(str)
-#define DEBUG_PRINTLN(str)
-#endif // #ifdef DEBUG
-#endif // #ifndef DEBUG_PRINT
-
 uint32_t checkForSoftwareUpdateMillis = 60 * 60 * 1000; // check for software update every 1 hour
 uint64_t lastCheckForUpdateMillis = 0;
 
@@ -55,7 +44,7 @@ void ESPGithubOtaUpdate::getLatestReleaseInfo(char *&version, char *&updateURL)
     String url = String("https://api.github.com/repos/") + releaseRepo + "/releases/latest";
     String payload;
 
-    DEBUG_PRINTLN(String("Requesting ") + url);
+    LOG_D("ota", "Requesting %s", url.c_str());
     httpClient.begin(secureClient, url);
     httpClient.addHeader("Authorization", String("token ") + authToken);
     int httpCode = httpClient.GET();
@@ -63,17 +52,20 @@ void ESPGithubOtaUpdate::getLatestReleaseInfo(char *&version, char *&updateURL)
     if (httpCode == HTTP_CODE_UNAUTHORIZED)
     {
         if (strlen(authToken) == 0)
-            Serial.println(F("Got 401 Unauthorized, and github token is empty. Check your configuration"));
+        {
+            LOG_E("ota", "Got 401 Unauthorized, and github token is empty. Check your configuration");
+        }
         else
-            Serial.println(F("Got 401 Unauthorized. Check if your github token is valid and not expired."));
+        {
+            LOG_E("ota", "Got 401 Unauthorized. Check if your github token is valid and not expired.");
+        }
     }
 
-    DEBUG_PRINT("OTA Update: got code ");
-    DEBUG_PRINTLN(String(httpCode));
+    LOG_D("ota", "OTA Update: got code %d", httpCode);
 
     if (httpCode == HTTP_CODE_OK)
     {
-        DEBUG_PRINTLN(String("Got response from ") + url);
+        LOG_D("ota", "Got response from %s", url.c_str());
         payload = httpClient.getString();
 
         JsonDocument doc;
@@ -89,8 +81,7 @@ void ESPGithubOtaUpdate::getLatestReleaseInfo(char *&version, char *&updateURL)
             if (String(name) == binaryFileName)
             {
                 const char *browserDownloadUrl = asset["browser_download_url"];
-                DEBUG_PRINT("OTA Update: found download URL: ");
-                DEBUG_PRINTLN(browserDownloadUrl);
+                LOG_D("ota", "OTA Update: found download URL: %s", browserDownloadUrl);
                 version = strdup(tagName);
                 updateURL = strdup(browserDownloadUrl);
                 break;
@@ -99,6 +90,7 @@ void ESPGithubOtaUpdate::getLatestReleaseInfo(char *&version, char *&updateURL)
     }
     else
     {
+        stats.checkErrors++;
         version = strdup("0.0.0");
         updateURL = nullptr;
     }
@@ -118,8 +110,7 @@ bool ESPGithubOtaUpdate::isNewerVersionAvailable(char *&latestVersion, char *&up
                           (latestMajor == currentMajor && latestMinor == currentMinor && latestPatch > currentPatch);
     if (newer_firmware)
     {
-        DEBUG_PRINT("Found new firmware at ");
-        DEBUG_PRINTLN(updateURL);
+        LOG_I("ota", "Found new firmware at %s", updateURL);
     }
 
     return newer_firmware;
@@ -136,20 +127,22 @@ ESPGithubOtaUpdate::ESPGithubOtaUpdate(const char *v, const char *b, const char
 
 void ESPGithubOtaUpdate::upgradeSoftware()
 {
+    HeapTraceScope heapTraceScope(HEAP_SCOPE_OTA);
     if (!isInited)
     {
-        DEBUG_PRINTLN(F("OTA Updater not inited. Exiting"));
+        LOG_W("ota", "OTA Updater not inited. Exiting");
         return;
     }
     char *latestVersion = nullptr;
     char *updateURL = nullptr;
+    stats.checks++;
     if (isNewerVersionAvailable(latestVersion, updateURL) && updateURL != nullptr)
     {
         upgradeSoftware(updateURL);
     }
     else
     {
-        Serial.println("Couldn't find new firmware");
+        LOG_I("ota", "Couldn't find new firmware");
     }
     if (latestVersion)
         free(latestVersion);
@@ -159,9 +152,10 @@ void ESPGithubOtaUpdate::upgradeSoftware()
 
 void ESPGithubOtaUpdate::upgradeSoftware(const char *updateURL)
 {
+    HeapTraceScope heapTraceScope(HEAP_SCOPE_OTA);
     if (!isInited || updateURL == nullptr || strlen(updateURL) == 0)
     {
-        Serial.println("OTA-Handler not initiated or invalid update URL.");
+        LOG_W("ota", "OTA-Handler not initiated or invalid update URL.");
         return;
     }
 
@@ -175,16 +169,17 @@ void ESPGithubOtaUpdate::upgradeSoftware(const char *updateURL)
 
     if (ret == HTTP_UPDATE_OK)
     {
-        Serial.println("Update successfully completed. Rebooting...");
+        LOG_I("ota", "Update successfully completed. Rebooting...");
         ESP.restart();
     }
     else
     {
         // If the update fails, print the error code and message
+        stats.updateFailures++;
 #ifdef ESP32
-        Serial.printf("HTTP Update failed error (%d): %s\n", httpUpdate.getLastError(), httpUpdate.getLastErrorString().c_str());
+        LOG_E("ota", "HTTP Update failed error (%d): %s", httpUpdate.getLastError(), httpUpdate.getLastErrorString().c_str());
 #elif defined(ESP8266)
-        Serial.printf("HTTP Update failed error (%d): %s\n", ESPhttpUpdate.getLastError(), ESPhttpUpdate.getLastErrorString().c_str());
+        LOG_E("ota", "HTTP Update failed error (%d): %s", ESPhttpUpdate.getLastError(), ESPhttpUpdate.getLastErrorString().c_str());
 #endif
     }
 }
@@ -194,92 +189,114 @@ void ESPGithubOtaUpdate::checkForSoftwareUpdate()
 #ifdef ESP8266
     handleEsp8266OtaUpdate();
 #endif
-    if (millis() - lastCheckForUpdateMillis > checkForSoftwareUpdateMillis)
+    if (millis() - lastCheckForUpdateMillis > checkForSoftwareUpdateMillis &&
+        enqueueJob("checkForUpdates", checkForUpdatesJob) != 0)
     {
         lastCheckForUpdateMillis = millis();
-
-        upgradeSoftware();
     }
 }
 
-void ESPGithubOtaUpdate::registerFirmwareUploadRoutes(AsyncWebServer *webServer, std::map<String, String> *routeDescriptions)
+bool checkForUpdatesJob()
 {
-    if (!webServer)
-        return;
+    if (updater == nullptr)
+        return false;
+#ifdef ESP32
+    httpUpdate.onProgress([](int current, int total)
+#elif defined(ESP8266)
+    ESPhttpUpdate.onProgress([](int current, int total)
+#endif
+                          {
+                              if (total > 0)
+                                  setJobProgress(static_cast<uint64_t>(current) * 100 / total);
+                          });
+    ESPGithubOtaUpdate::Stats before = updater->stats;
+    updater->upgradeSoftware(); // reboots if a newer firmware was flashed
+    return updater->stats.checkErrors == before.checkErrors && updater->stats.updateFailures == before.updateFailures;
+}
 
 #ifdef ESP8266
-    // For some weird bug, can't use AsyncWebServerRequest with Esp8266 for upload.
-    webServer->on("/uploadFirmware", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { request->redirect("http://" + WiFi.localIP().toString() + ":8888/"); });
-
-#elif defined(ESP32)
-    webServer->on("/uploadFirmware", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { request->send(200, "text/html", "<form method='POST' action='/firmwareUploadSave' enctype='multipart/form-data'>"
-                                                    "<input type='file' name='firmware'>"
-                                                    "<input type='submit' value='Upload Firmware'>"
-                                                    "</form>"); });
-
-    if (routeDescriptions != nullptr)
-    {
-        routeDescriptions->insert(std::make_pair("/uploadFirmware", "Upload firmware directly from the browser"));
-    }
-
-    webServer->on("/firmwareUploadSave", HTTP_POST, [](AsyncWebServerRequest *request) {}, // Placeholder for final response to the client, actual response will be sent in the upload handler
-                  [](AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final)
-                  {
-        if (!index)
-        {
-            Serial.printf("Update Start: %s\n", filename.c_str());
+// For some weird bug, can't use AsyncWebServerRequest with Esp8266 for upload.
+static void routeUploadFirmware(AsyncWebServerRequest *request)
+{
+    request->redirect("http://" + WiFi.localIP().toString() + ":8888/");
+}
 
-            bool updateStartOk = false;
+static const Route firmwareUploadRoutes[] = {
+    {"/uploadFirmware", HTTP_GET, routeUploadFirmware, nullptr},
+};
 
-            updateStartOk = Update.begin(UPDATE_SIZE_UNKNOWN);
-            if (!updateStartOk)
-            {
-                Update.printError(Serial);
-                request->send(500, "text/plain", "Update failed at start");
-                delay(2000);
-                return;
-            }
-            else
-            {
-                Serial.println("Update Started");
-                // printMemoryStatus(); // Print memory status after starting the update
-            }
+#elif defined(ESP32)
+static void routeUploadFirmware(AsyncWebServerRequest *request)
+{
+    sendWebAsset(request, "/uploadFirmware");
+}
 
-            Serial.println("Debug here 1");
-        }
+// Placeholder for final response to the client, actual response will be sent in the upload handler
+static void routeFirmwareUploadSave(AsyncWebServerRequest *request) {}
 
-        Serial.println("Debug here 2");
+static void firmwareUploadChunk(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+{
+    if (!index)
+    {
+        LOG_I("ota", "Update Start: %s", filename.c_str());
 
-        // Debugging before writing data
-        Serial.printf("Writing %u bytes at index %u\n", len, index);
+        bool updateStartOk = false;
 
-        // Write received data to the update
-        if (Update.write(data, len) != len)
+        updateStartOk = Update.begin(UPDATE_SIZE_UNKNOWN);
+        if (!updateStartOk)
         {
-            Update.printError(Serial);
-            request->send(500, "text/plain", "Update failed during write");
+            LOG_E("ota", "Update failed at start: %s", Update.errorString());
+            request->send(500, "text/plain", "Update failed at start");
             delay(2000);
             return;
         }
+        else
+        {
+            LOG_D("ota", "Update Started");
+            // printMemoryStatus(); // Print memory status after starting the update
+        }
+    }
 
-        yield(); // Yield to keep the system responsive during the long write process
+    LOG_D("ota", "Writing %u bytes at index %u", (unsigned)len, (unsigned)index);
 
-        if (final)
+    // Write received data to the update
+    if (Update.write(data, len) != len)
+    {
+        LOG_E("ota", "Update failed during write: %s", Update.errorString());
+        request->send(500, "text/plain", "Update failed during write");
+        delay(2000);
+        return;
+    }
+
+    yield(); // Yield to keep the system responsive during the long write process
+
+    if (final)
+    {
+        if (Update.end(true))
         {
-            if (Update.end(true))
-            {
-                Serial.printf("Update Success: %uB\n", index + len);
-                request->send(200, "text/plain", "Upload complete, device will restart.");
-                delay(3000); // Short delay to ensure the response is sent before reboot
-                ESP.restart();
-            }
-            else
-            {
-                Update.printError(Serial);
-                request->send(500, "text/plain", "Update failed at end");
-            }
-        } });
+            LOG_I("ota", "Update Success: %uB", (unsigned)(index + len));
+            request->send(200, "text/plain", "Upload complete, device will restart.");
+            delay(3000); // Short delay to ensure the response is sent before reboot
+            ESP.restart();
+        }
+        else
+        {
+            LOG_E("ota", "Update failed at end: %s", Update.errorString());
+            request->send(500, "text/plain", "Update failed at end");
+        }
+    }
+}
+
+static const Route firmwareUploadRoutes[] = {
+    {"/uploadFirmware", HTTP_GET, routeUploadFirmware, "Upload firmware directly from the browser"},
+    {"/firmwareUploadSave", HTTP_POST, routeFirmwareUploadSave, nullptr, firmwareUploadChunk},
+};
 #endif
+
+void ESPGithubOtaUpdate::registerFirmwareUploadRoutes(AsyncWebServer *webServer)
+{
+    if (!webServer)
+        return;
+
+    registerRoutes(webServer, firmwareUploadRoutes);
 }
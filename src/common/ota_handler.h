@@ -2,7 +2,6 @@
 #define OTA_HANDLER_H
 
 #include <Arduino.h>
-#include <map>
 #include <ESPAsyncWebServer.h>
 
 class ESPGithubOtaUpdate
@@ -18,11 +17,26 @@ private:
     bool isNewerVersionAvailable(char *&latestVersion, char *&updateURL);
 
 public:
+    struct Stats
+    {
+        uint32_t checks = 0;
+        uint32_t checkErrors = 0;
+        uint32_t updateFailures = 0;
+    } stats;
+
     ESPGithubOtaUpdate(const char *, const char *, const char *, const char *);
     void checkForSoftwareUpdate();
     void upgradeSoftware();
     void upgradeSoftware(const char *);
-    void registerFirmwareUploadRoutes(AsyncWebServer *, std::map<String, String> * = nullptr);
+    void registerFirmwareUploadRoutes(AsyncWebServer *);
 };
 
+/**
+ * Checks for new firmware and flashes it, on the job queue (see common/job_queue.h): the hourly
+ * check, the one at startup and /checkForUpdates all go through it, so two never run at once.
+ *
+ *   enqueueJob("checkForUpdates", checkForUpdatesJob);
+ */
+bool checkForUpdatesJob();
+
 #endif
@@ -0,0 +1,148 @@
+#include "common/response_cache.h"
+
+#include <stddef.h>
+
+#include "common/web_assets.h"
+
+// Only touched on the web server's task: bodies, their references and the slots
+struct CachedBody
+{
+    uint16_t refs; // the slot and each response sending it
+    size_t length;
+    char etag[11]; // quoted FNV-1a hash of data
+    char data[1];  // length bytes
+};
+
+struct CacheSlot
+{
+    const char *key; // nullptr when the slot is free
+    uint32_t version;
+    uint32_t renderedMillis;
+    uint32_t lastUsedMillis;
+    CachedBody *body;
+};
+static CacheSlot slots[RESPONSE_CACHE_SLOTS];
+static uint32_t stateVersion = 0;
+static uint32_t hits = 0;
+static uint32_t misses = 0;
+
+void bumpStateVersion()
+{
+#ifdef ESP32
+    __atomic_add_fetch(&stateVersion, 1, __ATOMIC_RELAXED);
+#elif defined(ESP8266)
+    stateVersion++; // loop and web server callbacks don't preempt each other
+#endif
+}
+
+uint32_t getStateVersion()
+{
+    return __atomic_load_n(&stateVersion, __ATOMIC_RELAXED);
+}
+
+static void release(CachedBody *body)
+{
+    if (body != nullptr && --body->refs == 0)
+        free(body);
+}
+
+// Sends a cached body without copying it, holding a reference to it until the response is done
+class CachedResponse : public AsyncAbstractResponse
+{
+public:
+    CachedResponse(const char *contentType, CachedBody *body) : body(body)
+    {
+        body->refs++;
+        _code = 200;
+        _contentType = contentType;
+        _contentLength = body->length;
+        _sendContentLength = true;
+        _chunked = false;
+    }
+    ~CachedResponse() { release(body); }
+    bool _sourceValid() const override { return true; }
+    size_t _fillBuffer(uint8_t *buf, size_t maxLen) override
+    {
+        size_t length = std::min(maxLen, body->length - offset);
+        memcpy(buf, body->data + offset, length);
+        offset += length;
+        return length;
+    }
+
+private:
+    CachedBody *body;
+    size_t offset = 0;
+};
+
+static CachedBody *makeBody(const String &rendered)
+{
+    CachedBody *body = static_cast<CachedBody *>(malloc(offsetof(CachedBody, data) + rendered.length()));
+    if (body == nullptr)
+        return nullptr;
+    body->refs = 1;
+    body->length = rendered.length();
+    memcpy(body->data, rendered.c_str(), body->length);
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < body->length; i++)
+        hash = (hash ^ static_cast<uint8_t>(body->data[i])) * 16777619u;
+    snprintf(body->etag, sizeof(body->etag), "\"%08x\"", (unsigned)hash);
+    return body;
+}
+
+// The slot cached under key, or the least recently used one, emptied for it
+static CacheSlot &slotFor(const char *key)
+{
+    CacheSlot *oldest = &slots[0];
+    for (CacheSlot &slot : slots)
+    {
+        if (slot.key != nullptr && strcmp(slot.key, key) == 0)
+            return slot;
+        if (oldest->key != nullptr && (slot.key == nullptr || slot.lastUsedMillis < oldest->lastUsedMillis))
+            oldest = &slot;
+    }
+    release(oldest->body);
+    *oldest = {key, 0, 0, 0, nullptr};
+    return *oldest;
+}
+
+void sendCachedResponse(AsyncWebServerRequest *request, const char *key, const char *contentType, ResponseRenderer render)
+{
+    CacheSlot &slot = slotFor(key);
+    uint32_t version = getStateVersion();
+    if (slot.body == nullptr || slot.version != version || millis() - slot.renderedMillis > RESPONSE_CACHE_MAX_AGE_MS)
+    {
+        misses++;
+        CachedBody *body = makeBody(render());
+        if (body == nullptr)
+        {
+            request->send(503, "text/plain", "Out of memory");
+            return;
+        }
+        release(slot.body);
+        slot.body = body;
+        slot.version = version;
+        slot.renderedMillis = millis();
+    }
+    else
+    {
+        hits++;
+    }
+    slot.lastUsedMillis = millis();
+
+    if (answerNotModified(request, slot.body->etag))
+        return;
+    AsyncWebServerResponse *response = new CachedResponse(contentType, slot.body);
+    addRevalidationHeaders(response, slot.body->etag);
+    request->send(response);
+}
+
+uint32_t getResponseCacheHits()
+{
+    return hits;
+}
+
+uint32_t getResponseCacheMisses()
+{
+    return misses;
+}
@@ -0,0 +1,33 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#define RESPONSE_CACHE_SLOTS 4            // cached responses, the least recently used is dropped
+#define RESPONSE_CACHE_MAX_AGE_MS 60000ul // for what no subsystem reports, e.g. the RSSI text
+
+/**
+ * Device state that pages are rendered from is versioned: whoever changes it (configuration,
+ * WiFi connection, quick restarts, routes...) calls bumpStateVersion(). Can be called from any task.
+ */
+void bumpStateVersion();
+uint32_t getStateVersion();
+
+// Renders the whole body
+typedef String (*ResponseRenderer)();
+
+/**
+ * Sends the body rendered by render, rendering it only when the state version changed since it
+ * was cached under key (or it's older than RESPONSE_CACHE_MAX_AGE_MS). Cached bodies are sent
+ * as they are stored, with a hash of the body as ETag: a browser revalidating gets a 304.
+ * A body being sent stays alive until its response is done, even if it's replaced meanwhile.
+ *
+ *   sendCachedResponse(request, "/", "text/plain", renderHome);
+ */
+void sendCachedResponse(AsyncWebServerRequest *request, const char *key, const char *contentType, ResponseRenderer render);
+
+uint32_t getResponseCacheHits();
+uint32_t getResponseCacheMisses();
+
+#endif // RESPONSE_CACHE_H
@@ -0,0 +1,169 @@
+#include "common/route_registry.h"
+
+#include "common/admission.h"
+#include "common/globals.h"
+#include "common/response_cache.h"
+
+struct RouteTable
+{
+    const Route *routes;
+    size_t count;
+    RouteStats *stats; // count of them, nullptr if there was no room left
+};
+static RouteTable routeTables[ROUTE_TABLE_MAX];
+static size_t routeTableCount = 0;
+static RouteStats routeStats[ROUTE_STATS_MAX];
+static size_t routeStatsUsed = 0;
+
+static void registerRoute(AsyncWebServer *server, const Route *route, RouteStats *stats)
+{
+    // Two pointers: small enough for std::function to keep them without allocating
+    auto handler = [route, stats](AsyncWebServerRequest *request)
+    {
+        if (admitRequest(request) != ADMISSION_ACCEPTED)
+        {
+            if (stats != nullptr)
+                stats->rejected++;
+            return;
+        }
+        if (stats != nullptr)
+            stats->accepted++;
+        route->handler(request);
+    };
+    if (route->upload == nullptr)
+    {
+        server->on(route->path, route->method, handler);
+        return;
+    }
+
+    // Uploads are admitted on their first chunk, the chunks of one turned down are dropped
+    auto upload = [route](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data,
+                          size_t len, bool final)
+    {
+        if (index == 0 ? admitRequest(request, true) != ADMISSION_ACCEPTED : !isRequestAdmitted(request))
+            return;
+        route->upload(request, filename, index, data, len, final);
+    };
+    server->on(route->path, route->method, handler, upload);
+}
+
+void registerRoutes(AsyncWebServer *server, const Route *routes, size_t count)
+{
+    RouteStats *stats = nullptr;
+    if (routeStatsUsed + count <= ROUTE_STATS_MAX)
+    {
+        stats = routeStats + routeStatsUsed;
+        routeStatsUsed += count;
+    }
+    else
+    {
+        LOG_W("routes", "more than %d routes, %u won't be counted", ROUTE_STATS_MAX, (unsigned)count);
+    }
+
+    for (size_t i = 0; i < count; i++)
+        registerRoute(server, &routes[i], stats != nullptr ? &stats[i] : nullptr);
+    bumpStateVersion(); // the route listings changed
+
+    if (routeTableCount < ROUTE_TABLE_MAX)
+        routeTables[routeTableCount++] = {routes, count, stats};
+    else
+        LOG_W("routes", "more than %d route tables, %u routes won't be listed", ROUTE_TABLE_MAX, (unsigned)count);
+}
+
+const Route *getListedRoute(size_t index)
+{
+    for (size_t t = 0; t < routeTableCount; t++)
+    {
+        for (size_t i = 0; i < routeTables[t].count; i++)
+        {
+            const Route &route = routeTables[t].routes[i];
+            if (route.description == nullptr)
+                continue;
+            if (index == 0)
+                return &route;
+            index--;
+        }
+    }
+    return nullptr;
+}
+
+RouteStats getRouteStats(const Route *route)
+{
+    for (size_t t = 0; t < routeTableCount; t++)
+    {
+        const RouteTable &table = routeTables[t];
+        if (route >= table.routes && route < table.routes + table.count && table.stats != nullptr)
+            return table.stats[route - table.routes];
+    }
+    return {0, 0};
+}
+
+const char *getRouteMethodName(WebRequestMethodComposite method)
+{
+    switch (method)
+    {
+    case HTTP_GET:
+        return "GET";
+    case HTTP_POST:
+        return "POST";
+    default:
+        return "ANY";
+    }
+}
+
+// Appends str to out (length bytes so far), escaped as in a JSON string if json, up to size bytes
+static size_t appendJson(char *out, size_t length, size_t size, const char *str, bool json = true)
+{
+    for (; *str != '\0'; str++)
+    {
+        char c = *str;
+        bool escaped = json && (c == '"' || c == '\\');
+        if (static_cast<uint8_t>(c) < 0x20)
+            continue;
+        if (length + (escaped ? 2 : 1) > size)
+            break;
+        if (escaped)
+            out[length++] = '\\';
+        out[length++] = c;
+    }
+    return length;
+}
+
+// Renders the next route, with the '[' or ',' before it, or the closing ']'
+size_t RouteListResponse::renderNext(char *entry, size_t size)
+{
+    if (done)
+        return 0;
+    const Route *route = getListedRoute(routeIndex);
+    size_t length = 0;
+    if (routeIndex == 0)
+        entry[length++] = '[';
+    if (route == nullptr)
+    {
+        entry[length++] = ']';
+        done = true;
+        return length;
+    }
+    if (routeIndex > 0)
+        entry[length++] = ',';
+    routeIndex++;
+
+    RouteStats stats = getRouteStats(route);
+    char suffix[48];
+    size_t suffixLength = snprintf(suffix, sizeof(suffix), "\",\"accepted\":%u,\"rejected\":%u}",
+                                   (unsigned)stats.accepted, (unsigned)stats.rejected);
+    size -= suffixLength;
+    length = appendJson(entry, length, size, "{\"path\":\"", false);
+    length = appendJson(entry, length, size, route->path);
+    length = appendJson(entry, length, size, "\",\"method\":\"", false);
+    length = appendJson(entry, length, size, getRouteMethodName(route->method));
+    length = appendJson(entry, length, size, "\",\"description\":\"", false);
+    length = appendJson(entry, length, size, route->description);
+    memcpy(entry + length, suffix, suffixLength);
+    return length + suffixLength;
+}
+
+void routeApiRoutes(AsyncWebServerRequest *request)
+{
+    request->send(new RouteListResponse(request->version() > 0));
+}
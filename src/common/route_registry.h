@@ -0,0 +1,73 @@
+#ifndef ROUTE_REGISTRY_H
+#define ROUTE_REGISTRY_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "common/block_response.h"
+
+#define ROUTE_TABLE_MAX 4          // route tables registered: common, project, OTA, + 1
+#define ROUTE_STATS_MAX 40         // routes with accepted/rejected counters
+#define ROUTE_JSON_ENTRY_SIZE 256  // one route in /api/routes, longer descriptions are truncated
+
+typedef void (*RouteHandler)(AsyncWebServerRequest *request);
+typedef void (*RouteUploadHandler)(AsyncWebServerRequest *request, const String &filename, size_t index,
+                                   uint8_t *data, size_t len, bool final);
+
+struct Route
+{
+    const char *path;
+    WebRequestMethodComposite method;
+    RouteHandler handler;
+    const char *description;   // nullptr: not listed, "": listed without a description
+    RouteUploadHandler upload; // nullptr unless the route takes file uploads
+};
+
+/**
+ * Routes are declared in const tables of plain function pointers, so that their path, method and
+ * description are never copied to the heap:
+ *
+ *   static const Route projectRoutes[] = {
+ *       {"/status", HTTP_GET, routeStatus, "Pump status"},
+ *   };
+ *   registerRoutes(webServer, projectRoutes);
+ *
+ * Each route is handed to AsyncWebServer::on behind admission control (see common/admission.h),
+ * and the table is remembered (the pointer only) for the listings on / and /api/routes, which
+ * just walk the tables in registration order.
+ */
+void registerRoutes(AsyncWebServer *server, const Route *routes, size_t count);
+template <size_t N>
+void registerRoutes(AsyncWebServer *server, const Route (&routes)[N])
+{
+    registerRoutes(server, routes, N);
+}
+
+struct RouteStats
+{
+    uint32_t accepted;
+    uint32_t rejected;
+};
+
+// Listed routes (description != nullptr), index from 0 until it returns nullptr
+const Route *getListedRoute(size_t index);
+RouteStats getRouteStats(const Route *route);
+const char *getRouteMethodName(WebRequestMethodComposite method);
+
+// /api/routes: [{"path":"/","method":"GET","description":"","accepted":3,"rejected":0},...], streamed one route at a time
+class RouteListResponse : public BlockResponse<ROUTE_JSON_ENTRY_SIZE>
+{
+public:
+    explicit RouteListResponse(bool chunked) : BlockResponse("application/json", chunked) {}
+
+protected:
+    size_t renderNext(char *entry, size_t size) override;
+
+private:
+    size_t routeIndex = 0;
+    bool done = false;
+};
+
+void routeApiRoutes(AsyncWebServerRequest *request);
+
+#endif // ROUTE_REGISTRY_H
@@ -8,43 +8,46 @@
 #endif
 
 #include "common/globals.h"
+#include "common/route_registry.h"
+#include "common/telemetry_events.h"
 
 AsyncWebServer *webServer;
-std::map<String, String> routeDescriptions;
+
+static const Route commonRoutes[] = {
+    {"/reboot", HTTP_GET, rootReboot, ""},
+    {"/configureDevice", HTTP_GET, routeConfigure, "Device configuration (wifi, hostname, github token)"},
+    {"/saveConfiguration", HTTP_POST, routeSaveConfiguration, nullptr},
+    {"/invalidateConfig", HTTP_GET, routeInvaldateConfig, ""},
+    {"/checkForUpdates", HTTP_GET, routeCheckUpdate, "Checks for newer firmware on github"},
+    {"/logsStream", HTTP_GET, routeLogsStream, "Get a logs streaming for remote debugging"},
+    {"/logs", HTTP_GET, routeLogs, "Log history kept across resets (?since=<seq> for the newer records)"},
+    {"/logClients", HTTP_GET, routeLogClients, "Queued bytes, dropped lines and latency per logs websocket client (CSV)"},
+    {"/memoryStats", HTTP_GET, routeMemoryStats, "Free heap stats and per minute/hour/day rollups (CSV)"},
+    {"/metrics", HTTP_GET, routeMetrics, "Device metrics in Prometheus text format"},
+#if defined(HEAP_TRACE) && defined(ESP32)
+    {"/heapTrace", HTTP_GET, routeHeapTrace, "Live and peak heap bytes per subsystem (CSV)"},
+#endif
+    {"/api/status", HTTP_GET, routeApiStatus, "Version, uptime, heap, WiFi and OTA state (JSON)"},
+    {"/api/config", HTTP_GET, routeApiConfig, "Device configuration, secrets masked (JSON)"},
+    {"/api/jobs", HTTP_GET, routeApiJobs, "Jobs queued by the routes above, /api/jobs/<id> for one (JSON)"},
+    {"/api/routes", HTTP_GET, routeApiRoutes, "Routes with their method and description (JSON)"},
+};
 
 void setupServer()
 {
     webServer = new AsyncWebServer(80);
 
     // Default routes
-    webServer->on("/reboot", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { rootReboot(request); });
-    routeDescriptions["/reboot"] = "";
-
-    webServer->on("/configureDevice", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { routeConfigure(request); });
-    routeDescriptions["/configureDevice"] = "Device configuration (wifi, hostname, github token)";
-
-    webServer->on("/saveConfiguration", HTTP_POST, [](AsyncWebServerRequest *request)
-                  { routeSaveConfiguration(request); });
-
-    webServer->on("/invalidateConfig", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { routeInvaldateConfig(request); });
-    routeDescriptions["/invalidateConfig"] = "";
-
-    webServer->on("/checkForUpdates", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { routeCheckUpdate(request); });
-    routeDescriptions["/checkForUpdates"] = "Checks for newer firmware on github";
-
+    wsLogs.onEvent(onEvent);
     webServer->addHandler(&wsLogs);
-    webServer->on("/logsStream", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { routeLogsStream(request); });
-    routeDescriptions["/logsStream"] = "Get a logs streaming for remote debugging";
+    beginTelemetryEvents(webServer);
+    registerRoutes(webServer, commonRoutes);
 
     // Add more routes here
     // if (!configMode)
     // {
-    //     webServer->on("/routePath", HTTP_MODE, func);
+    //     static const Route routes[] = {{"/routePath", HTTP_MODE, func, "Description"}};
+    //     registerRoutes(webServer, routes);
     // }
 
     // Start the server
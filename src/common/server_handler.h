@@ -13,6 +13,16 @@ void routeSaveConfiguration(AsyncWebServerRequest *request);
 void routeInvaldateConfig(AsyncWebServerRequest *request);
 void routeCheckUpdate(AsyncWebServerRequest *request);
 void routeLogsStream(AsyncWebServerRequest *request);
+void routeMemoryStats(AsyncWebServerRequest *request);
+void routeMetrics(AsyncWebServerRequest *request);
+void routeLogs(AsyncWebServerRequest *request);
+void routeLogClients(AsyncWebServerRequest *request);
+void routeApiStatus(AsyncWebServerRequest *request);
+void routeApiConfig(AsyncWebServerRequest *request);
+void routeApiJobs(AsyncWebServerRequest *request);
+#if defined(HEAP_TRACE) && defined(ESP32)
+void routeHeapTrace(AsyncWebServerRequest *request);
+#endif
 
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
              void *arg, uint8_t *data, size_t len);
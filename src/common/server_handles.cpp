@@ -1,81 +1,184 @@
 #include "Arduino.h"
 
+#ifdef ESP32
+#include <WiFi.h>
+#elif defined(ESP8266)
+#include <ESP8266WiFi.h>
+#endif
+
 #include "server_handler.h"
+#include "common/admission.h"
 #include "common/globals.h"
+#include "common/heap_trace.h"
+#include "common/html_template.h"
+#include "common/job_queue.h"
+#include "common/json_arena.h"
+#include "common/log_clients.h"
+#include "common/log_history.h"
+#include "common/metrics.h"
+#include "common/utils.h"
+#include "common/web_assets.h"
 
 #include "device_configuration.h"
 #include "wifi_handler.h"
 
+// Serializes doc straight into the response, or answers 500 if it didn't fit in the JSON arena
+static void sendJson(AsyncWebServerRequest *request, const JsonDocument &doc, int code = 200, const char *location = nullptr)
+{
+    if (doc.overflowed())
+    {
+        LOG_E("api", "%s doesn't fit in JSON_ARENA_SIZE", request->url().c_str());
+        request->send(500, "text/plain", "Response too large");
+        return;
+    }
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->setCode(code);
+    if (location != nullptr)
+        response->addHeader("Location", location);
+    serializeJson(doc, *response);
+    request->send(response);
+}
+
+static void addJobStatus(JsonObject json, const JobStatus &status)
+{
+    json["id"] = status.id;
+    json["name"] = status.name;
+    json["state"] = jobStateName(status.state);
+    json["progress"] = status.progress;
+    json["queuedMs"] = (status.state == JOB_QUEUED ? millis() : status.startedMillis) - status.queuedMillis;
+    if (status.state != JOB_QUEUED)
+        json["runMs"] = (status.state == JOB_RUNNING ? millis() : status.finishedMillis) - status.startedMillis;
+}
+
+// 202 with the job to poll, or 503 when the job queue is full
+static void sendJobAccepted(AsyncWebServerRequest *request, uint32_t id, const char *message)
+{
+    JobStatus status;
+    if (!getJobStatus(id, status))
+    {
+        AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Job queue full");
+        response->addHeader("Retry-After", "5");
+        request->send(response);
+        return;
+    }
+    char location[24];
+    snprintf(location, sizeof(location), "/api/jobs/%u", (unsigned)id);
+    JsonDocument doc(resetJsonArena());
+    addJobStatus(doc.to<JsonObject>(), status);
+    doc["message"] = message;
+    sendJson(request, doc, 202, location);
+}
+
+static bool rebootJob()
+{
+    delay(3000); // lets the response go out
+    ESP.restart();
+    return true;
+}
+
+static bool invalidateConfigJob()
+{
+    invalidateDeviceConfigurationOnEeprom();
+    return rebootJob();
+}
+
 void rootReboot(AsyncWebServerRequest *request)
 {
     DEBUG_PRINTLN("rootReboot");
 
-    request->send(200, "text/plain", F("Rebooting now."));
-    delay(3000);
-    ESP.restart();
+    sendJobAccepted(request, enqueueJob("reboot", rebootJob), "Rebooting now.");
 }
 
 void routeInvaldateConfig(AsyncWebServerRequest *request)
 {
     DEBUG_PRINTLN("routeInvaldateConfig");
 
-    invalidateDeviceConfigurationOnEeprom();
-    request->send(200, "text/plain", F("Device configuration voided. Configure at /configureDevice. Rebooting now."));
-    ESP.restart();
+    sendJobAccepted(request, enqueueJob("invalidateConfig", invalidateConfigJob), "Device configuration voided. Configure at /configureDevice. Rebooting now.");
 }
 
 void routeCheckUpdate(AsyncWebServerRequest *request)
 {
     DEBUG_PRINTLN("routeCheckUpdate");
 
-    request->send(200, "text/html", F("Checking for new firmware on github. This might take a few seconds..."));
-    updater->upgradeSoftware();
-}
-
-String formatDeviceConfigurationHtmlTemplate()
-{
-    String ssid_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->ssid;
-    String password_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->password;
-    String hostname_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->hostname;
-    String deviceName_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->deviceName;
-    String githubAuthToken_str = currentDeviceConfiguration == nullptr ? "" : currentDeviceConfiguration->githubAuthToken;
-
-    return String("<!DOCTYPE html> \
-    <html><head><meta charset=\"utf-8\"><title>Configuration</title></head><body> \
-    <form method=\"post\" action=\"/saveConfiguration\"> \
-<label for=\"ssid\">WiFi SSID:</label>\
-                        <input type =\"text\" id=\"ssid\" name=\"ssid\" value=\"" +
-                  ssid_str + "\">\
-<br><br>\
-<label for=\"password\">WiFi Password:</label> \
-<input type=\"password\" id=\"password\" name=\"password\" value=\"" +
-                  password_str + "\">\
-<br><br>\
-<label for=\"hostname\">Hostname</label>\
-<input type=\"text\" id=\"hostname\" name=\"hostname\" value=\"" +
-                  hostname_str + "\">\
-<br><br>\
-<label for=\"device_name\">Device name</label>\
-<input type=\"text\" id=\"device_name\" name=\"device_name\" value=\"" +
-                  deviceName_str + "\"> \
-<br><br>\
-<label for=\"auth_token\">Github Auth Token</label>\
-<input type=\"text\" id=\"auth_token\" name=\"auth_token\" value=\"" +
-                  githubAuthToken_str + "\">\
-<br><br>\
-\
-<input type=\"submit\" value=\"Save\"></form></body></html>");
+    sendJobAccepted(request, enqueueJob("checkForUpdates", checkForUpdatesJob), "Checking for new firmware on github.");
+}
+
+void routeApiJobs(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeApiJobs");
+
+    JsonDocument doc(resetJsonArena());
+    const String &url = request->url();
+    const char *id = url.c_str() + strlen("/api/jobs");
+    if (*id == '/')
+    {
+        JobStatus status;
+        if (!getJobStatus(strtoul(id + 1, nullptr, 10), status))
+        {
+            request->send(404, "text/plain", "No such job");
+            return;
+        }
+        addJobStatus(doc.to<JsonObject>(), status);
+    }
+    else
+    {
+        JobStatus statuses[JOB_SLOTS];
+        size_t count = getJobStatuses(statuses, JOB_SLOTS);
+        JsonArray array = doc.to<JsonArray>();
+        for (size_t i = 0; i < count; i++)
+            addJobStatus(array.add<JsonObject>(), statuses[i]);
+    }
+    sendJson(request, doc);
+}
+
+static const char deviceConfigurationPage[] PROGMEM = R"(<!DOCTYPE html>
+<html><head><meta charset="utf-8"><title>Configuration</title></head><body>
+<form method="post" action="/saveConfiguration">
+<label for="ssid">WiFi SSID:</label>
+<input type="text" id="ssid" name="ssid" value="{{ssid}}">
+<br><br>
+<label for="password">WiFi Password:</label>
+<input type="password" id="password" name="password" value="{{password}}">
+<br><br>
+<label for="hostname">Hostname</label>
+<input type="text" id="hostname" name="hostname" value="{{hostname}}">
+<br><br>
+<label for="device_name">Device name</label>
+<input type="text" id="device_name" name="device_name" value="{{device_name}}">
+<br><br>
+<label for="auth_token">Github Auth Token</label>
+<input type="text" id="auth_token" name="auth_token" value="{{auth_token}}">
+<br><br>
+<input type="submit" value="Save"></form></body></html>)";
+
+static bool deviceConfigurationValue(const char *name, Print &out)
+{
+    const DeviceConfiguration *config = currentDeviceConfiguration;
+    if (config == nullptr)
+        return true; // empty form
+    if (strcmp(name, "ssid") == 0)
+        out.print(config->ssid);
+    else if (strcmp(name, "password") == 0)
+        out.print(config->password);
+    else if (strcmp(name, "hostname") == 0)
+        out.print(config->hostname);
+    else if (strcmp(name, "device_name") == 0)
+        out.print(config->deviceName);
+    else if (strcmp(name, "auth_token") == 0)
+        out.print(config->githubAuthToken);
+    else
+        return false;
+    return true;
 }
 
 void routeConfigure(AsyncWebServerRequest *request)
 {
     DEBUG_PRINTLN("routeConfigure");
-    request->send(200, "text/html", formatDeviceConfigurationHtmlTemplate());
+    request->send(new HtmlTemplateResponse(deviceConfigurationPage, deviceConfigurationValue, request->version() > 0));
 }
 
 void routeSaveConfiguration(AsyncWebServerRequest *request)
 {
-    Serial.print("HEREHEHERE");
     DEBUG_PRINTLN("routeSaveConfiguration");
 
     String ssid = request->arg("ssid");
@@ -87,45 +190,176 @@ void routeSaveConfiguration(AsyncWebServerRequest *request)
     if (hostName == "")
         hostName = configModeHostname;
 
-    DeviceConfiguration *newConfig = new DeviceConfiguration(ssid.c_str(), password.c_str(), hostName.c_str(), deviceName.c_str(), authToken.c_str());
+    DeviceConfiguration newConfig(ssid.c_str(), password.c_str(), hostName.c_str(), deviceName.c_str(), authToken.c_str());
+
+    saveDeviceConfigurationToEeprom(newConfig);
+    request->send(200, "text/plain", "Configuration saved. Connecting to WiFi with the provided credentials, progress at /api/status.");
+    // Leaving config mode's access point once the response is out
+    onRequestDisconnect(request, []()
+                        {
+                            LOG_PRINTLN(F("Configuration accepted, connecting to WiFi."));
+                            setupWifi(false);
+                        });
+}
 
-    // Send a response to the client
-    request->send(200, "text/plain", F("Configuration received. Will attempt connection to WiFi with provided credentials. Will save configuration if successful."));
-    delay(250);
+void routeLogsStream(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogsStream");
+    sendWebAsset(request, "/logsStream");
+}
 
-    currentDeviceConfiguration = newConfig;
-    saveDeviceConfigurationToEeprom();
-    if (setupWifi())
+template <size_t N>
+void printMemoryRollups(AsyncResponseStream *response, const char *resolution, const MemoryRollupRing<N> &rollups)
+{
+    for (size_t age = 0; age < rollups.size(); age++)
     {
-        LOG_PRINTLN(F("Configuration accepted."));
-        // saveQuickRestartsToEeprom(false);
-        // ESP.restart(); // Note: will not reach this point if connection to Wifi is unsuccessful
+        const MemoryRollup &rollup = rollups.get(age);
+        response->printf("%s,%u,%u,%u,%u\n", resolution, (unsigned)age, rollup.min, rollup.max, rollup.average);
     }
-    else
+}
+
+void routeMemoryStats(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeMemoryStats");
+
+    AsyncResponseStream *response = request->beginResponseStream("text/csv");
+    response->print("resolution,age,min,max,average\n");
+    response->printf("window,0,%u,%u,%u\n", ramStats.getMin(), ramStats.getMax(), (uint32_t)ramStats.getAverage());
+    printMemoryRollups(response, "minute", ramStats.minuteRollups);
+    printMemoryRollups(response, "hour", ramStats.hourRollups);
+    printMemoryRollups(response, "day", ramStats.dayRollups);
+    request->send(response);
+}
+
+void routeMetrics(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeMetrics");
+
+    request->send(new MetricsResponse(request->version() > 0));
+}
+
+void routeLogs(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogs");
+
+    uint32_t since = 0;
+    if (request->hasParam("since"))
+        since = strtoul(request->getParam("since")->value().c_str(), nullptr, 10);
+    request->send(new LogHistoryResponse(since, request->version() > 0));
+}
+
+void routeLogClients(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeLogClients");
+
+    LogClientStats stats[LOG_CLIENT_MAX];
+    size_t count = getLogClientStats(stats, LOG_CLIENT_MAX);
+    AsyncResponseStream *response = request->beginResponseStream("text/csv");
+    response->print("client,queuedBytes,droppedLines,frames,bytes,lastLatencyMs,maxLatencyMs\n");
+    for (size_t i = 0; i < count; i++)
     {
-        LOG_PRINTLN(F("Unable to connect to WiFI, configuration discarded."));
+        response->printf("%u,%u,%u,%u,%u,%u,%u\n", stats[i].id, stats[i].queuedBytes, stats[i].droppedLines,
+                         stats[i].frames, stats[i].bytes, stats[i].lastLatencyMs, stats[i].maxLatencyMs);
     }
+    request->send(response);
 }
 
-void routeLogsStream(AsyncWebServerRequest *request)
+#if defined(HEAP_TRACE) && defined(ESP32)
+void routeHeapTrace(AsyncWebServerRequest *request)
 {
-    DEBUG_PRINTLN("routeLogsStream");
-    String html = R"(<!DOCTYPE html><html><head><script>
-var ws = new WebSocket('ws://' + window.location.hostname + ':80/wsLogs');
-ws.onmessage = function(event) {
-  var container = document.getElementById('logContainer');
-
-  var now = new Date();
-  var timestamp = now.getHours() + ':' + now.getMinutes() + ':' + now.getSeconds();
-  var newMessage = timestamp + " - " + event.data + "\n";
-  container.textContent = newMessage + container.textContent;
-};
-</script></head><body>
-<h1>Log Messages</h1>
-<pre id='logContainer'></pre>
-</body></html>
-)";
-    request->send(200, "text/html", html);
+    DEBUG_PRINTLN("routeHeapTrace");
+
+    AsyncResponseStream *response = request->beginResponseStream("text/csv");
+    response->print("scope,liveBytes,peakBytes,allocations,frees\n");
+    for (uint8_t scope = 0; scope < HEAP_SCOPE_COUNT; scope++)
+    {
+        HeapScopeStats stats = getHeapScopeStats(static_cast<HeapScope>(scope));
+        response->printf("%s,%u,%u,%u,%u\n", heapScopeName(static_cast<HeapScope>(scope)),
+                         stats.liveBytes, stats.peakBytes, stats.allocations, stats.frees);
+    }
+    response->printf("untracked,,,%u,\n", getUntrackedAllocations());
+    request->send(response);
+}
+#endif
+
+// Whether a secret is set, without its value or length
+static const char *maskSecret(const char *secret)
+{
+    return secret[0] != '\0' ? "********" : "";
+}
+
+void routeApiStatus(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeApiStatus");
+
+    JsonDocument doc(resetJsonArena());
+    doc["version"] = SW_VERSION;
+    doc["binary"] = BINARY_NAME;
+    doc["uptimeSeconds"] = getUptimeSeconds();
+    doc["bootCount"] = getLogHistoryBootCount();
+    doc["resetReason"] = getResetReason();
+    doc["quickRestarts"] = quickRestartsCount;
+    doc["configMode"] = configMode;
+    doc["bootLoopMode"] = bootLoopMode;
+
+    JsonObject heap = doc["heap"].to<JsonObject>();
+    heap["free"] = ESP.getFreeHeap();
+    heap["min"] = ramStats.getMin();
+    heap["max"] = ramStats.getMax();
+    heap["average"] = static_cast<uint32_t>(ramStats.getAverage());
+#ifdef ESP8266
+    heap["maxFreeBlock"] = ramStats.maxFreeBlockSize;
+    heap["fragmentation"] = ramStats.heapFragmentation;
+#endif
+
+    bool connected = WiFi.status() == WL_CONNECTED;
+    IPAddress ip = isWifiAccessPoint() ? WiFi.softAPIP() : WiFi.localIP();
+    char ipText[16];
+    snprintf(ipText, sizeof(ipText), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    JsonObject wifi = doc["wifi"].to<JsonObject>();
+    WifiStats wifiStats = getWifiStats();
+    wifi["mode"] = isWifiAccessPoint() ? "ap" : "station";
+    wifi["state"] = wifiStateName(getWifiState());
+    wifi["connected"] = connected;
+    wifi["attempts"] = wifiStats.attempts;
+    wifi["failures"] = wifiStats.failures;
+    wifi["lastConnectMillis"] = wifiStats.lastConnectMillis;
+    wifi["ip"] = ipText;
+    if (currentDeviceConfiguration != nullptr)
+        wifi["hostname"] = currentDeviceConfiguration->hostname;
+    if (connected)
+    {
+        wifi["ssid"] = WiFi.SSID();
+        wifi["rssi"] = WiFi.RSSI();
+    }
+
+    JsonObject ota = doc["ota"].to<JsonObject>();
+    ota["checks"] = updater ? updater->stats.checks : 0;
+    ota["checkErrors"] = updater ? updater->stats.checkErrors : 0;
+    ota["updateFailures"] = updater ? updater->stats.updateFailures : 0;
+
+    sendJson(request, doc);
+}
+
+void routeApiConfig(AsyncWebServerRequest *request)
+{
+    DEBUG_PRINTLN("routeApiConfig");
+
+    JsonDocument doc(resetJsonArena());
+    const DeviceConfiguration *config = currentDeviceConfiguration;
+    if (config != nullptr)
+    {
+        doc["ssid"] = config->ssid;
+        doc["password"] = maskSecret(config->password);
+        doc["hostname"] = config->hostname;
+        doc["deviceName"] = config->deviceName;
+        doc["githubAuthToken"] = maskSecret(config->githubAuthToken);
+    }
+    else
+    {
+        doc.to<JsonObject>(); // {} when there's no valid configuration
+    }
+    sendJson(request, doc);
 }
 
 AsyncWebSocket wsLogs("/wsLogs");
@@ -135,23 +369,67 @@ void handleWebSocketMessage(void *arg, uint8_t *data, size_t len)
     if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT)
     {
         data[len] = 0; // Null-terminate the data (if text)
-        String message = "WebSocket message: " + String((char *)data);
-        LOG_PRINTLN(message);
+        LOG_I("ws", "WebSocket message: %s", (const char *)data);
     }
 }
 
+// Sends the log history up to endSeq to a client that just connected, in a single frame
+static void replayLogHistory(AsyncWebSocketClient *client, uint32_t endSeq)
+{
+    HeapTraceScope heapTraceScope(HEAP_SCOPE_LOGGING);
+    LogHistoryCursor cursor(getLogHistoryFirstSeq());
+    size_t size = getLogHistorySize(cursor.seq, endSeq);
+    if (size == 0)
+        return;
+    AsyncWebSocketMessageBuffer *buffer = wsLogs.makeBuffer(size);
+    if (buffer == nullptr)
+        return;
+    size_t length = readLogHistory(cursor, endSeq, buffer->get(), size);
+    // Records dropped since the size was taken leave a few bytes at the end: blank lines
+    memset(buffer->get() + length, '\n', size - length);
+#ifdef LOG_BINARY
+    client->binary(buffer);
+#else
+    client->text(buffer);
+#endif
+}
+
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
              void *arg, uint8_t *data, size_t len)
 {
     switch (type)
     {
     case WS_EVT_CONNECT:
-        LOG_PRINTLN("WebSocket " + String(server->url()) + " client #" + String(client->id()) +
-                    " connected from " + client->remoteIP().toString());
+    {
+        IPAddress ip = client->remoteIP();
+        LOG_I("ws", "WebSocket %s client #%u connected from %u.%u.%u.%u", server->url(), client->id(), ip[0], ip[1], ip[2], ip[3]);
+        if (server == &wsLogs)
+        {
+            lockLogClients();
+            uint32_t replayEndSeq = getLogHistoryNextSeq();
+            bool added = addLogClient(client, replayEndSeq);
+            if (added)
+                replayLogHistory(client, replayEndSeq); // before the drain can send it live lines
+            unlockLogClients();
+            if (!added)
+            {
+                LOG_W("ws", "Too many log clients, closing #%u", client->id());
+                client->close();
+                break;
+            }
+            setLogWebsocketAttached(true);
+        }
         break;
+    }
     case WS_EVT_DISCONNECT:
-        LOG_PRINTLN("WebSocket " + String(server->url()) + " client #" + String(client->id()) +
-                    " disconnected");
+        LOG_I("ws", "WebSocket %s client #%u disconnected", server->url(), client->id());
+        if (server == &wsLogs)
+        {
+            lockLogClients();
+            removeLogClient(client->id());
+            unlockLogClients();
+            setLogWebsocketAttached(wsLogs.count() > 0);
+        }
         break;
     case WS_EVT_DATA:
         handleWebSocketMessage(arg, data, len);
@@ -160,10 +438,3 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType
         break;
     }
 }
-
-void sendToLogsWebsocket(const String &message)
-{
-    // Check if there are WebSocket clients connected
-    if (wsLogs.count() > 0)
-        wsLogs.textAll(message); // Send message to all connected log WebSocket clients
-}
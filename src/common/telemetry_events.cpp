@@ -0,0 +1,165 @@
+#include "common/telemetry_events.h"
+
+#ifdef ESP32
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#endif
+
+#include "common/globals.h"
+#include "common/metrics.h"
+
+static AsyncEventSource telemetryEvents("/events");
+static uint32_t intervalMs = TELEMETRY_EVENTS_INTERVAL_MS;
+static uint32_t lastFrameMillis = 0;
+
+// Names, values as of the last frame, and the id of the frame each one last changed in. The names
+// are copied from the registry by the loop, the web server's task only reads these.
+static const char *names[METRICS_MAX_COUNT];
+static int32_t values[METRICS_MAX_COUNT];
+static uint32_t changedIds[METRICS_MAX_COUNT];
+static size_t knownCount = 0;
+static uint32_t firstId = 0;
+static uint32_t lastId = 0;
+
+static char frame[TELEMETRY_FRAME_SIZE];        // loop
+static char connectFrame[TELEMETRY_FRAME_SIZE]; // web server task
+
+// Frames are taken by the loop, clients connect on the web server's task
+#ifdef ESP32
+static portMUX_TYPE telemetryLock = portMUX_INITIALIZER_UNLOCKED;
+#define LOCK_TELEMETRY() portENTER_CRITICAL(&telemetryLock)
+#define UNLOCK_TELEMETRY() portEXIT_CRITICAL(&telemetryLock)
+#elif defined(ESP8266)
+#define LOCK_TELEMETRY()
+#define UNLOCK_TELEMETRY()
+#endif
+
+// true if id a comes after id b, ids wrap around
+static bool after(uint32_t a, uint32_t b)
+{
+    return static_cast<int32_t>(a - b) > 0;
+}
+
+// Renders {"name":value,...} with the metrics that changed after frame since, or all of them if full
+static size_t renderFrame(char *out, const char *const *frameNames, const int32_t *frameValues,
+                          const uint32_t *frameChangedIds, size_t count, bool full, uint32_t since)
+{
+    size_t length = 0;
+    out[length++] = '{';
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!full && !after(frameChangedIds[i], since))
+            continue;
+        int written = snprintf(out + length, TELEMETRY_FRAME_SIZE - length, "%s\"%s\":%ld", length > 1 ? "," : "",
+                               frameNames[i], static_cast<long>(frameValues[i]));
+        if (written < 0 || length + written + 2 > TELEMETRY_FRAME_SIZE)
+            break; // the rest doesn't fit, TELEMETRY_FRAME_SIZE is too small
+        length += written;
+    }
+    out[length++] = '}';
+    out[length] = '\0';
+    return length;
+}
+
+// Reads the metrics, returns true if any changed (or was registered) since the last frame
+static bool takeFrame()
+{
+    size_t count = getMetricCount();
+    uint32_t id = lastId + 1;
+    bool changed = false;
+    for (size_t i = 0; i < count; i++)
+    {
+        int32_t value = getMetric(i)->read();
+        if (i < knownCount && value == values[i])
+            continue;
+        LOCK_TELEMETRY();
+        names[i] = getMetric(i)->name;
+        values[i] = value;
+        changedIds[i] = id;
+        UNLOCK_TELEMETRY();
+        changed = true;
+    }
+    if (changed)
+    {
+        LOCK_TELEMETRY();
+        knownCount = count;
+        lastId = id;
+        UNLOCK_TELEMETRY();
+    }
+    return changed;
+}
+
+// Turns down connections over TELEMETRY_EVENTS_MAX_CLIENTS before the event source takes them:
+// it's added to the server first, so it's asked first
+class TelemetryEventsLimit : public AsyncWebHandler
+{
+public:
+    bool canHandle(AsyncWebServerRequest *request) override
+    {
+        return telemetryEvents.count() >= TELEMETRY_EVENTS_MAX_CLIENTS && request->url() == "/events";
+    }
+    void handleRequest(AsyncWebServerRequest *request) override
+    {
+        LOG_W("events", "%d clients already, turning a new one down", TELEMETRY_EVENTS_MAX_CLIENTS);
+        AsyncWebServerResponse *response = request->beginResponse(503, "text/plain", "Too many event clients");
+        response->addHeader("Retry-After", "10");
+        request->send(response);
+    }
+};
+static TelemetryEventsLimit telemetryEventsLimit;
+
+static void onConnect(AsyncEventSourceClient *client)
+{
+    const char *frameNames[METRICS_MAX_COUNT];
+    int32_t frameValues[METRICS_MAX_COUNT];
+    uint32_t frameChangedIds[METRICS_MAX_COUNT];
+    LOCK_TELEMETRY();
+    size_t count = knownCount;
+    uint32_t id = lastId;
+    uint32_t first = firstId;
+    memcpy(frameNames, names, count * sizeof(names[0]));
+    memcpy(frameValues, values, count * sizeof(values[0]));
+    memcpy(frameChangedIds, changedIds, count * sizeof(changedIds[0]));
+    UNLOCK_TELEMETRY();
+
+    // Resume from a frame of this boot, that the client may have missed the next ones of
+    uint32_t since = client->lastId();
+    bool resume = since != 0 && !after(first, since) && !after(since, id);
+    renderFrame(connectFrame, frameNames, frameValues, frameChangedIds, count, !resume, since);
+    client->send(connectFrame, resume ? "delta" : "snapshot", id, TELEMETRY_EVENTS_RECONNECT_MS);
+}
+
+void beginTelemetryEvents(AsyncWebServer *server)
+{
+#ifdef ESP32
+    firstId = esp_random();
+#elif defined(ESP8266)
+    firstId = RANDOM_REG32;
+#endif
+    if (firstId == 0)
+        firstId = 1; // 0 is no Last-Event-ID
+    lastId = firstId - 1;
+    takeFrame();
+    lastFrameMillis = millis();
+
+    telemetryEvents.onConnect(onConnect);
+    server->addHandler(&telemetryEventsLimit);
+    server->addHandler(&telemetryEvents);
+}
+
+void loopTelemetryEvents()
+{
+    if (millis() - lastFrameMillis < intervalMs)
+        return;
+    lastFrameMillis = millis();
+
+    if (!takeFrame() || telemetryEvents.count() == 0)
+        return;
+    renderFrame(frame, names, values, changedIds, knownCount, false, lastId - 1);
+    telemetryEvents.send(frame, "delta", lastId);
+}
+
+void setTelemetryEventsInterval(uint32_t interval)
+{
+    intervalMs = interval;
+}
@@ -0,0 +1,32 @@
+#ifndef TELEMETRY_EVENTS_H
+#define TELEMETRY_EVENTS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "common/metrics.h"
+
+#define TELEMETRY_EVENTS_INTERVAL_MS 1000 // default, or set at runtime with setTelemetryEventsInterval()
+#define TELEMETRY_EVENTS_RECONNECT_MS 3000
+#define TELEMETRY_EVENTS_MAX_CLIENTS 4
+#define TELEMETRY_FRAME_SIZE (METRICS_MAX_COUNT * 48) // a frame with every metric: its name and value
+
+/**
+ * Server-Sent Events at /events, built from the metrics registered for /metrics (see
+ * common/metrics.h). Every interval the metrics are read, and the ones that changed since the
+ * previous frame are sent to all clients in a single "delta" event:
+ *
+ *   event: delta
+ *   id: 2841571907
+ *   data: {"esp_heap_free_bytes":181452,"esp_wifi_rssi_dbm":-61}
+ *
+ * No frame is sent when nothing changed. A client that connects gets a "snapshot" event with
+ * every metric, or, when it reconnects with the Last-Event-ID of a frame from this boot, a
+ * "delta" with what changed since that frame. Frame ids start at random at boot, so an id from
+ * an earlier boot isn't mistaken for a recent frame.
+ */
+void beginTelemetryEvents(AsyncWebServer *server);
+void loopTelemetryEvents();
+void setTelemetryEventsInterval(uint32_t intervalMs);
+
+#endif // TELEMETRY_EVENTS_H
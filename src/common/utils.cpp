@@ -4,6 +4,8 @@
 
 #ifdef ESP32
 #include <WiFi.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #elif defined(ESP8266)
 #include <ESP8266WiFi.h>
 #endif
@@ -79,4 +81,46 @@ String millisToTimeStr(uint64_t millisValue)
 
     timeStr += String(seconds) + "s";
     return timeStr;
-}
\ No newline at end of file
+}
+
+String getResetReason()
+{
+#ifdef ESP32
+    switch (esp_reset_reason())
+    {
+    case ESP_RST_POWERON:
+        return "Power on";
+    case ESP_RST_EXT:
+        return "External pin";
+    case ESP_RST_SW:
+        return "Software";
+    case ESP_RST_PANIC:
+        return "Panic";
+    case ESP_RST_INT_WDT:
+        return "Interrupt watchdog";
+    case ESP_RST_TASK_WDT:
+        return "Task watchdog";
+    case ESP_RST_WDT:
+        return "Other watchdog";
+    case ESP_RST_DEEPSLEEP:
+        return "Deep sleep wakeup";
+    case ESP_RST_BROWNOUT:
+        return "Brownout";
+    case ESP_RST_SDIO:
+        return "SDIO";
+    default:
+        return "Unknown";
+    }
+#elif defined(ESP8266)
+    return ESP.getResetReason();
+#endif
+}
+
+uint32_t getUptimeSeconds()
+{
+#ifdef ESP32
+    return esp_timer_get_time() / 1000000;
+#elif defined(ESP8266)
+    return micros64() / 1000000;
+#endif
+}
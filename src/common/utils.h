@@ -6,4 +6,6 @@
 String stringMask(const String &str, char mask);
 String getWifiStrength();
 String millisToTimeStr(uint64_t);
+String getResetReason();
+uint32_t getUptimeSeconds();
 #endif // UTILS_H
\ No newline at end of file
@@ -0,0 +1,81 @@
+#include "common/web_assets.h"
+
+#include <web_assets_data.h> // generated by extra_script_pre.py
+
+#include "common/globals.h"
+
+const WebAsset *findWebAsset(const char *path)
+{
+    for (size_t i = 0; i < webAssetCount; i++)
+    {
+        if (strcmp(webAssets[i].path, path) == 0)
+            return &webAssets[i];
+    }
+    return nullptr;
+}
+
+bool sendWebAsset(AsyncWebServerRequest *request, const char *path)
+{
+    const WebAsset *asset = findWebAsset(path);
+    if (asset == nullptr)
+    {
+        LOG_E("web", "no web asset for %s", path);
+        request->send(404, "text/plain", "Not found");
+        return false;
+    }
+
+    if (answerNotModified(request, asset->etag))
+        return true;
+    AsyncWebServerResponse *response = request->beginResponse_P(200, asset->mime, asset->data, asset->length);
+    response->addHeader("Content-Encoding", "gzip");
+    addRevalidationHeaders(response, asset->etag);
+    request->send(response);
+    return true;
+}
+
+// Weak comparison (RFC 7232): the W/ of either tag is left out
+static bool etagListed(const char *list, const char *etag)
+{
+    size_t etagLength = strlen(etag);
+    while (*list != '\0')
+    {
+        if (*list == ' ' || *list == '\t' || *list == ',')
+        {
+            list++;
+            continue;
+        }
+        if (*list == '*')
+            return true;
+        if (strncmp(list, "W/", 2) == 0)
+            list += 2;
+        const char *end = list;
+        if (*end == '"')
+        {
+            end = strchr(end + 1, '"');
+            end = end != nullptr ? end + 1 : list + strlen(list);
+        }
+        while (*end != '\0' && *end != ',' && *end != ' ' && *end != '\t')
+            end++;
+        if (static_cast<size_t>(end - list) == etagLength && strncmp(list, etag, etagLength) == 0)
+            return true;
+        list = end;
+    }
+    return false;
+}
+
+bool answerNotModified(AsyncWebServerRequest *request, const char *etag)
+{
+    AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+    if (ifNoneMatch == nullptr || !etagListed(ifNoneMatch->value().c_str(), etag))
+        return false;
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    addRevalidationHeaders(response, etag);
+    request->send(response);
+    return true;
+}
+
+void addRevalidationHeaders(AsyncWebServerResponse *response, const char *etag)
+{
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache"); // may be cached, but revalidated with the ETag
+}
@@ -0,0 +1,36 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/**
+ * The files in web/, minified and gzipped at build time by extra_script_pre.py into a table
+ * kept in flash. They are sent as they are stored (Content-Encoding: gzip), straight from flash,
+ * with an ETag: browsers revalidate on every load and get a 304 with no body while the firmware
+ * still has the same file.
+ */
+struct WebAsset
+{
+    const char *path;
+    const char *mime;
+    const uint8_t *data; // gzipped, PROGMEM
+    size_t length;
+    const char *etag;
+};
+
+const WebAsset *findWebAsset(const char *path);
+
+// Sends the asset (or a 304), or a 404 and returns false if there's no asset for path
+bool sendWebAsset(AsyncWebServerRequest *request, const char *path);
+
+/**
+ * Revalidation, shared with the response cache (common/response_cache.h). etag is quoted.
+ * answerNotModified sends a 304 and returns true when the request's If-None-Match lists etag,
+ * weak (W/) or not, or is "*". Otherwise nothing is sent: send the body, with the headers
+ * added by addRevalidationHeaders so that the browser keeps it but asks again next time.
+ */
+bool answerNotModified(AsyncWebServerRequest *request, const char *etag);
+void addRevalidationHeaders(AsyncWebServerResponse *response, const char *etag);
+
+#endif // WEB_ASSETS_H
@@ -4,90 +4,109 @@
 #ifdef ESP32
 #include <WiFi.h>
 #include <ESPmDNS.h>
+#include <freertos/FreeRTOS.h>
 #elif defined(ESP8266)
 #include <ESP8266WiFi.h>
 #include <ESP8266mDNS.h>
 #endif
 
 #include "common/globals.h"
+#include "common/heap_trace.h"
+#include "common/response_cache.h"
 #include "device_configuration.h"
 
 const char *ssid, *password, *hostname;
 
 uint64_t lastCheckedMillis = 0;
 
-bool connectWiFi(const char *ssid, const char *password, const char *hostname)
-{
-    bool connected = false;
-    uint8_t numRetries = 5;
-    IPAddress ipAddress = IPAddress((uint32_t)0);
+static WifiState state = WIFI_STATE_IDLE;
+static bool accessPointMode = false;
+static uint8_t failedAttempts = 0;     // in a row, since the last setupWifi() or connection
+static uint32_t nextAttemptMillis = 0; // IDLE waits until then
+static uint32_t attemptStartMillis = 0;
+static WifiStats stats = {};
 
-#ifdef ESP8266
-    WiFi.setSleepMode(WIFI_NONE_SLEEP);
+// Set by setupWifi() and the WiFi events, taken by loopWiFi(). The events are latched until the
+// state that acts on them is reached, the latest of the two wins.
+static bool setupRequested = false;
+static bool requestedAccessPoint = false;
+static bool gotIp = false;
+static bool disconnected = false;
+static uint32_t gotIpMillis = 0;
+
+// setupWifi() is called from the jobs task and the events come on the WiFi event task
+#ifdef ESP32
+static portMUX_TYPE wifiLock = portMUX_INITIALIZER_UNLOCKED;
+#define LOCK_WIFI() portENTER_CRITICAL(&wifiLock)
+#define UNLOCK_WIFI() portEXIT_CRITICAL(&wifiLock)
+#elif defined(ESP8266)
+#define LOCK_WIFI()
+#define UNLOCK_WIFI()
 #endif
 
-    if (configMode)
-    {
-        WiFi.mode(WIFI_AP);
-        connected = WiFi.softAP(ssid, password);
-        ipAddress = WiFi.softAPIP();
-    }
-    else
-    {
-        while (!connected && numRetries-- > 0)
-        {
-            WiFi.mode(WIFI_STA);
-            // Uncomment to set dns
-            // WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, dns);
-            WiFi.begin(ssid, password);
-            DEBUG_PRINT(F("Connecting to WiFi..."));
-            uint64_t connectionAttemptBeginMillis = millis();
-
-            while (millis() - connectionAttemptBeginMillis < wifiConnectionMaxMillis && !connected)
-            {
-                delay(500);
-                DEBUG_PRINT(F("."));
-                if (WiFi.status() == WL_CONNECTED)
-                {
-                    connected = true;
-                    ipAddress = WiFi.localIP();
-                }
-            }
-            if (!connected)
-                DEBUG_PRINTLN(F("\nUnable to connect. Trying again."));
-        }
-        if (!connected)
-        {
-            DEBUG_PRINTLN(F("Connection to WiFi unsuccessful. Entering config mode"));
-            configMode = true;
-            return setupWifi();
-            // this is actually very dangerous. Don't uncomment unless you know exactly what you
-            // are doing. And even then, remember that you did it once you hit unwanted behavior.
-            // saveQuickRestartsToEeprom(true); // use the just restarted logic to enter in config mode
-            // ESP.restart(); 
-                              
-        }
-        DEBUG_PRINTLN("\nConnected to WiFi with IP address " + ipAddress.toString());
-    }
+static void onGotIp()
+{
+    LOCK_WIFI();
+    gotIp = true;
+    gotIpMillis = millis();
+    disconnected = false;
+    UNLOCK_WIFI();
+}
 
-    // Initialize mDNS
-    MDNS.end();
-    delay(1000);
-    if (!MDNS.begin(hostname))
-    {
-        LOG_PRINTLN(F("Error setting up MDNS responder!"));
-    }
-    DEBUG_PRINTLN("mDNS responder started with hostname " + String(hostname));
+static void onDisconnected()
+{
+    LOCK_WIFI();
+    disconnected = true;
+    gotIp = false;
+    UNLOCK_WIFI();
+}
 
-    return true;
+#ifdef ESP32
+static void onWifiEvent(WiFiEvent_t event, WiFiEventInfo_t info)
+{
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+        onGotIp();
+    else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED)
+        onDisconnected();
+}
+#elif defined(ESP8266)
+static WiFiEventHandler gotIpHandler, disconnectedHandler;
+#endif
+
+static void registerWifiEvents()
+{
+#ifdef ESP32
+    WiFi.onEvent(onWifiEvent);
+#elif defined(ESP8266)
+    gotIpHandler = WiFi.onStationModeGotIP([](const WiFiEventStationModeGotIP &)
+                                           { onGotIp(); });
+    disconnectedHandler = WiFi.onStationModeDisconnected([](const WiFiEventStationModeDisconnected &)
+                                                         { onDisconnected(); });
+#endif
 }
 
-bool setupWifi()
+void setupWifi(bool accessPoint)
 {
+    LOCK_WIFI();
+    setupRequested = true;
+    requestedAccessPoint = accessPoint;
+    UNLOCK_WIFI();
+}
+
+// Turns the radio off, the next attempt is made once it had time to reset
+static void resetRadio(bool accessPoint)
+{
+    HeapTraceScope heapTraceScope(HEAP_SCOPE_WIFI);
     LOG_PRINT(F("Setting up WiFi in "));
-    LOG_PRINT(configMode ? F("AP") : F("STA"));
+    LOG_PRINT(accessPoint ? F("AP") : F("STA"));
     LOG_PRINTLN(F(" mode."));
-    if (configMode)
+    if (!accessPoint && currentDeviceConfiguration == nullptr)
+    {
+        LOG_W("wifi", "No valid configuration to connect with, entering config mode");
+        configMode = true;
+        accessPoint = true;
+    }
+    if (accessPoint)
     {
         ssid = configModeSsid;
         password = "";
@@ -100,37 +119,203 @@ bool setupWifi()
         hostname = currentDeviceConfiguration->hostname;
     }
 
+    MDNS.end();
     WiFi.disconnect();
-    delay(200);
     WiFi.softAPdisconnect(true);
-    delay(200);
     WiFi.mode(WIFI_OFF); // Turn off to reset the Wi-Fi mode
-    delay(3000);         // Short delay to allow Wi-Fi hardware to reset
-
-    return connectWiFi(ssid, password, hostname);
+    accessPointMode = accessPoint;
+    failedAttempts = 0;
+    state = WIFI_STATE_IDLE;
+    nextAttemptMillis = millis() + wifiRadioResetMillis;
 }
 
-void loopWiFi()
+static void beginAttempt()
 {
+    HeapTraceScope heapTraceScope(HEAP_SCOPE_WIFI);
 #ifdef ESP8266
-    MDNS.update();
+    WiFi.setSleepMode(WIFI_NONE_SLEEP);
 #endif
 
-    if (configMode)
+    if (accessPointMode)
+    {
+        WiFi.mode(WIFI_AP);
+        if (WiFi.softAP(ssid, password))
+        {
+            state = WIFI_STATE_GOT_IP;
+            return;
+        }
+        LOG_E("wifi", "Unable to start the access point %s", ssid);
+        nextAttemptMillis = millis() + wifiRetryBackoffMillis;
         return;
+    }
 
-    // Make sure WiFi is connected, reconnect if necessary
-    if (millis() - lastCheckedMillis >= wifiConnectionStatusCheckMillis)
+    LOCK_WIFI();
+    gotIp = false;
+    disconnected = false;
+    UNLOCK_WIFI();
+    WiFi.mode(WIFI_STA);
+    // Uncomment to set dns
+    // WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE, dns);
+    WiFi.begin(ssid, password);
+    stats.attempts++;
+    attemptStartMillis = millis();
+    state = WIFI_STATE_CONNECTING;
+    LOG_D("wifi", "Connecting to %s, attempt %u of %u", ssid, failedAttempts + 1, wifiConnectionMaxAttempts);
+}
+
+void beginWifi()
+{
+    registerWifiEvents();
+    resetRadio(configMode);
+    beginAttempt(); // nothing to wait for at boot, and the web server needs the network stack up
+}
+
+static void failAttempt(wl_status_t status)
+{
+    stats.failures++;
+    failedAttempts++;
+    LOG_W("wifi", "Attempt %u failed after %lu ms, status %d", failedAttempts,
+          static_cast<unsigned long>(millis() - attemptStartMillis), status);
+    WiFi.disconnect();
+    state = WIFI_STATE_IDLE;
+
+    if (failedAttempts >= wifiConnectionMaxAttempts)
+    {
+        LOG_E("wifi", "Connection to WiFi unsuccessful. Entering config mode");
+        configMode = true;
+        resetRadio(true);
+        return;
+    }
+    uint32_t backoff = wifiRetryBackoffMillis << (failedAttempts - 1);
+    nextAttemptMillis = millis() + backoff;
+}
+
+static void startMdns()
+{
+    if (!accessPointMode)
+    {
+        IPAddress ipAddress = WiFi.localIP();
+        LOG_I("wifi", "Connected to WiFi with IP address %u.%u.%u.%u in %lu ms", ipAddress[0], ipAddress[1],
+              ipAddress[2], ipAddress[3], static_cast<unsigned long>(stats.lastConnectMillis));
+    }
+
+    // Initialize mDNS
+    if (!MDNS.begin(hostname))
+    {
+        LOG_E("wifi", "Error setting up MDNS responder!");
+    }
+    LOG_D("wifi", "mDNS responder started with hostname %s", hostname);
+    state = WIFI_STATE_MDNS_UP;
+
+    if (!accessPointMode && configMode)
+    {
+        configMode = false;
+        LOG_PRINTLN("Got valid configuration and connected to wifi.");
+    }
+    bumpStateVersion();
+}
+
+// Lost on the disconnection event, or, should one be missed, on WiFi.status() checked now and then
+static bool connectionLost(bool disconnectEvent)
+{
+    if (disconnectEvent)
+        return true;
+    if (millis() - lastCheckedMillis < wifiConnectionStatusCheckMillis)
+        return false;
+    lastCheckedMillis = millis();
+    return WiFi.status() != WL_CONNECTED;
+}
+
+void loopWiFi()
+{
+    LOCK_WIFI();
+    bool requested = setupRequested;
+    bool accessPoint = requestedAccessPoint;
+    bool ipEvent = gotIp;
+    bool disconnectEvent = disconnected;
+    uint32_t ipMillis = gotIpMillis;
+    setupRequested = false;
+    if (state == WIFI_STATE_MDNS_UP)
+        disconnected = false; // taken, acted on below
+    UNLOCK_WIFI();
+
+    if (requested)
+    {
+        resetRadio(accessPoint);
+        return;
+    }
+
+    switch (state)
     {
-        lastCheckedMillis = millis();
-        WiFiClient client;
-        const char *host = "www.google.com";
-        const int port = 80; // HTTP port
+    case WIFI_STATE_IDLE:
+        if (static_cast<int32_t>(millis() - nextAttemptMillis) >= 0)
+            beginAttempt();
+        break;
+
+    case WIFI_STATE_CONNECTING:
+    {
+        wl_status_t status = WiFi.status();
+        if (ipEvent || status == WL_CONNECTED)
+        {
+            stats.lastConnectMillis = (ipEvent ? ipMillis : millis()) - attemptStartMillis;
+            failedAttempts = 0;
+            state = WIFI_STATE_GOT_IP;
+        }
+        else if (status == WL_CONNECT_FAILED || millis() - attemptStartMillis >= wifiConnectionMaxMillis)
+        {
+            failAttempt(status);
+        }
+        break;
+    }
+
+    case WIFI_STATE_GOT_IP:
+        startMdns();
+        break;
 
-        if (WiFi.status() != WL_CONNECTED || !client.connect(host, port))
+    case WIFI_STATE_MDNS_UP:
+#ifdef ESP8266
+        MDNS.update();
+#endif
+        if (accessPointMode)
+            break;
+        if (connectionLost(disconnectEvent))
         {
-            LOG_PRINTLN("Wifi disconnected. Attemting new wifi setupx");
-            setupWifi();
+            LOG_W("wifi", "Connection lost, status %d. Reconnecting", WiFi.status());
+            MDNS.end();
+            state = WIFI_STATE_IDLE;
+            nextAttemptMillis = millis();
         }
+        break;
     }
 }
+
+WifiState getWifiState()
+{
+    return state;
+}
+
+const char *wifiStateName(WifiState wifiState)
+{
+    switch (wifiState)
+    {
+    case WIFI_STATE_IDLE:
+        return "idle";
+    case WIFI_STATE_CONNECTING:
+        return "connecting";
+    case WIFI_STATE_GOT_IP:
+        return "got_ip";
+    case WIFI_STATE_MDNS_UP:
+        return "mdns_up";
+    }
+    return "unknown";
+}
+
+bool isWifiAccessPoint()
+{
+    return accessPointMode;
+}
+
+WifiStats getWifiStats()
+{
+    return stats;
+}
@@ -1,7 +1,43 @@
 #ifndef WIFI_HANDLER_H
 #define WIFI_HANDLER_H
 
-bool setupWifi();
+#include <Arduino.h>
+
+/**
+ * WiFi is brought up by a state machine that never blocks: setupWifi() only asks for a
+ * connection, and loopWiFi() advances it a step at a time from the loop, on the WiFi events
+ * and timers, so the loop and the watchdog keep running while connecting.
+ *
+ *   IDLE -> CONNECTING -> GOT_IP -> MDNS_UP
+ *
+ * An attempt that gets no IP in wifiConnectionMaxMillis is retried after a backoff, doubled each
+ * time; after wifiConnectionMaxAttempts the device falls back to config mode's access point.
+ * Losing the connection starts over from IDLE. Config mode ends once a station connection is up.
+ */
+enum WifiState : uint8_t
+{
+    WIFI_STATE_IDLE,       // radio off, or waiting out the backoff before the next attempt
+    WIFI_STATE_CONNECTING, // WiFi.begin() called, waiting for an IP
+    WIFI_STATE_GOT_IP,     // connected (or access point up), mDNS not started yet
+    WIFI_STATE_MDNS_UP,
+};
+
+struct WifiStats
+{
+    uint32_t attempts;
+    uint32_t failures;          // attempts that timed out or were refused
+    uint32_t lastConnectMillis; // from WiFi.begin() to the IP, of the last attempt that connected
+};
+
+// Starts the radio, as access point in config mode, before the web server is set up
+void beginWifi();
+// Reconnects to the configured network, or brings up config mode's access point. Can be called from any task.
+void setupWifi(bool accessPoint);
 void loopWiFi();
 
-#endif
\ No newline at end of file
+WifiState getWifiState();
+const char *wifiStateName(WifiState state);
+bool isWifiAccessPoint();
+WifiStats getWifiStats();
+
+#endif
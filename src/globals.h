@@ -5,7 +5,7 @@
 #include "common/globals.h"
 #include "system_config.h"
 
-extern SystemConfiguration *systemConfiguration;
+extern const SystemConfiguration *systemConfiguration;
 
 // extern MySensor *mySensor;
 // extern const char *myConst;
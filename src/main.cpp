@@ -22,6 +22,7 @@ void setup(void)
   // addServerHandles();
 
   // project-specific eeprom config, if any
+  // migrateConfigOnEeprom();
   // readConfigFromEeprom();
 
   // Init components
@@ -6,13 +6,13 @@
 
 
 #include "globals.h"
+#include "common/html_template.h"
+#include "common/response_cache.h"
 #include "common/utils.h"
 #include "serverHandles.h"
 
-void routeHomeComplete(AsyncWebServerRequest *request)
+static String renderHome()
 {
-    DEBUG_PRINTLN("routeHome");
-
     // Software Version
     String currentConfigStr = "\n\n---\nSoftware version: " + String(SW_VERSION);
 
@@ -32,14 +32,18 @@ void routeHomeComplete(AsyncWebServerRequest *request)
     //     currentConfigStr += F("\tNo valid configuration was found.");
 
     // Routes description
-    if (!routeDescriptions.empty())
+    const Route *route = getListedRoute(0);
+    if (route != nullptr)
     {
         currentConfigStr += "\n\n---\nAvailable services:\n";
-        // Iterate over the map and print the key-value pairs
-        for (const auto &pair : routeDescriptions)
+        for (size_t i = 1; route != nullptr; route = getListedRoute(i++))
         {
-            currentConfigStr += pair.first;
-            currentConfigStr += !pair.second.isEmpty() ? (": " + pair.second) : "";
+            currentConfigStr += route->path;
+            if (route->description[0] != '\0')
+            {
+                currentConfigStr += ": ";
+                currentConfigStr += route->description;
+            }
             currentConfigStr += "\n";
         }
     }
@@ -47,34 +51,44 @@ void routeHomeComplete(AsyncWebServerRequest *request)
     // Components data
     // <components_data>
 
-    request->send(200, "text/plain", currentConfigStr);
+    return currentConfigStr;
 }
 
-void addServerHandles()
+void routeHomeComplete(AsyncWebServerRequest *request)
 {
-    webServer->on("/", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { routeHomeComplete(request); });
-    routeDescriptions["/"] = "";
+    DEBUG_PRINTLN("routeHome");
 
-    webServer->on("/configure", HTTP_GET, [](AsyncWebServerRequest *request)
-                  { routeConfigureBoard(request); });
-    routeDescriptions["/configure"] = "Configure sump pump manager settings";
+    // Re-rendered once bumpStateVersion() is called (or after RESPONSE_CACHE_MAX_AGE_MS)
+    sendCachedResponse(request, "/", "text/plain", renderHome);
 }
 
-String formatConfigurationHtmlTemplate()
+static const Route projectRoutes[] = {
+    {"/", HTTP_GET, routeHomeComplete, ""},
+    {"/configure", HTTP_GET, routeConfigureBoard, "Configure sump pump manager settings"},
+};
+
+void addServerHandles()
+{
+    registerRoutes(webServer, projectRoutes);
+}
+
+static const char configurationPage[] PROGMEM = R"(<!DOCTYPE html><html><head><meta charset='utf-8'><title>System Configuration</title></head><body>
+<form method='post' action='/saveConfig'>
+<label for='myConfig'>My config char:</label>
+<input type='text' id='myConfig' name='myConfig' value='{{myConfig}}'><br><br>
+<input type='submit' value='Save'></form></body></html>)";
+
+static bool configurationValue(const char *name, Print &out)
 {
-    String myConfig = String(systemConfiguration->myConfig);
-
-    return String("<!DOCTYPE html><html><head><meta charset='utf-8'><title>System Configuration</title></head><body>\
-<form method='post' action='/saveConfig'>\
-<label for='myConfig'>My config char:</label>\
-<input type='text' id='myConfig' name='myConfig' value='" +
-                  myConfig + "'><br><br>\
-<input type='submit' value='Save'></form></body></html>");
+    if (strcmp(name, "myConfig") == 0)
+        out.print(systemConfiguration->myConfig);
+    else
+        return false;
+    return true;
 }
 
 void routeConfigureBoard(AsyncWebServerRequest *request)
 {
     DEBUG_PRINTLN("routeConfigureBoard")
-    request->send(200, "text/html", formatConfigurationHtmlTemplate());
+    request->send(new HtmlTemplateResponse(configurationPage, configurationValue, request->version() > 0));
 }
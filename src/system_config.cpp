@@ -3,38 +3,43 @@
 #include "common/eeprom_utils.tpp"
 #include "common/globals.h"
 
-int SYSTEM_CONFIGURATION_EEPROM_ADDR;
-SystemConfiguration *systemConfiguration = nullptr;
+const SystemConfiguration *systemConfiguration = nullptr;
+
+void migrateConfigOnEeprom()
+{
+    // Register upgrades from older schema versions here, e.g.
+    // registerEepromUpgrade<SystemConfiguration>(1, upgradeSystemConfigurationV1);
+    migrateEepromData<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR);
+}
 
 bool readConfigFromEeprom()
 {
     DEBUG_PRINTLN(F("EEPROM: SPM configuration: read"));
-    SystemConfiguration *eepromConfig = readDataFromEeprom<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR);
+    const SystemConfiguration *eepromConfig = readDataFromEeprom<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR);
     if (eepromConfig != nullptr)
     {
         systemConfiguration = eepromConfig;
         DEBUG_PRINTLN(systemConfiguration->toStr());
         return true;
     }
-    LOG_PRINTLN(F(">>WARNING: got invalid configuration info from EEPROM"));
+    LOG_W("eeprom", "got invalid configuration info from EEPROM");
     return false;
 }
 
-void saveConfigToEeprom()
+void saveConfigToEeprom(const SystemConfiguration &config)
 {
     DEBUG_PRINTLN(F("EEPROM: configuration: write"));
-    DEBUG_PRINTLN(systemConfiguration->toStr());
-    if (systemConfiguration == nullptr)
-        return;
+    DEBUG_PRINTLN(config.toStr());
 
-    writeDataToEeprom<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR, systemConfiguration);
+    writeDataToEeprom<SystemConfiguration>(SYSTEM_CONFIGURATION_EEPROM_ADDR, &config);
+    readConfigFromEeprom();
     DEBUG_PRINTLN(F("Done writing to EEPROM"));
 }
 
 void SystemConfiguration::initDefaultConfiguration()
 {
-    delete systemConfiguration;
-    systemConfiguration = new SystemConfiguration('R');
+    static const SystemConfiguration defaultConfiguration('R');
+    systemConfiguration = &defaultConfiguration;
 }
 
 void invalidateSystemConfigurationOnEeprom()
@@ -3,11 +3,16 @@
 
 #include "Arduino.h"
 
+#include "common/eeprom_layout.h"
+
 // Data Structure Alignment
 #pragma pack(push, 1)
 
 struct SystemConfiguration
 {
+    static constexpr uint16_t SCHEMA_VERSION = 1;
+    static constexpr uint16_t EEPROM_CAPACITY = 32;
+
     char myConfig;
 
     SystemConfiguration() {}
@@ -24,10 +29,16 @@ struct SystemConfiguration
     static void initDefaultConfiguration();
 };
 
+#pragma pack(pop)
+
+// Project structs stored in the EEPROM, placed after the common ones
+using AppEepromLayout = CommonEepromLayout::Append<SystemConfiguration>;
+
+constexpr int SYSTEM_CONFIGURATION_EEPROM_ADDR = AppEepromLayout::address<SystemConfiguration>();
+
+void migrateConfigOnEeprom();
 bool readConfigFromEeprom();
-void saveConfigToEeprom();
+void saveConfigToEeprom(const SystemConfiguration &config);
 void invalidateSystemConfigurationOnEeprom();
 
-#pragma pack(pop)
-
 #endif // SENSOR_CONFIG_H
@@ -0,0 +1,66 @@
+#ifndef MOCK_ARDUINO_H
+#define MOCK_ARDUINO_H
+
+// Just enough of the Arduino core to build the platform independent sources on the host (env:native)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#define PROGMEM
+#define IRAM_ATTR
+#define PSTR(s) (s)
+#define F(s) reinterpret_cast<const __FlashStringHelper *>(s)
+#define pgm_read_byte(address) (*reinterpret_cast<const uint8_t *>(address))
+#define pgm_read_dword(address) (*reinterpret_cast<const uint32_t *>(address))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+using std::max;
+using std::min;
+
+class __FlashStringHelper;
+
+class String
+{
+public:
+    String(const char *text = "") : text(text) {}
+    String(const std::string &text) : text(text) {}
+    String(const __FlashStringHelper *text) : text(reinterpret_cast<const char *>(text)) {}
+    explicit String(long value) : text(std::to_string(value)) {}
+    explicit String(unsigned long value) : text(std::to_string(value)) {}
+    explicit String(int value) : text(std::to_string(value)) {}
+    explicit String(unsigned int value) : text(std::to_string(value)) {}
+
+    const char *c_str() const { return text.c_str(); }
+    unsigned int length() const { return text.length(); }
+    String &operator+=(const String &other)
+    {
+        text += other.text;
+        return *this;
+    }
+    String &operator+=(const char *other)
+    {
+        text += other;
+        return *this;
+    }
+    bool operator==(const String &other) const { return text == other.text; }
+
+private:
+    std::string text;
+};
+
+inline unsigned long &mockMillis()
+{
+    static unsigned long now = 0;
+    return now;
+}
+
+inline unsigned long millis()
+{
+    return mockMillis();
+}
+
+#endif // MOCK_ARDUINO_H
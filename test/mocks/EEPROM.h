@@ -0,0 +1,30 @@
+#ifndef MOCK_EEPROM_H
+#define MOCK_EEPROM_H
+
+#include <Arduino.h>
+
+// The EEPROM library's RAM copy, with the commits counted
+class EEPROMClass
+{
+public:
+    uint8_t data[4096];
+    size_t size = 0;
+    unsigned commits = 0;
+
+    bool begin(size_t size_)
+    {
+        size = size_;
+        return size <= sizeof(data);
+    }
+    uint8_t *getDataPtr() { return data; }
+    bool commit()
+    {
+        commits++;
+        return true;
+    }
+    bool end() { return true; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // MOCK_EEPROM_H
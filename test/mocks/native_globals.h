@@ -0,0 +1,26 @@
+#ifndef MOCK_NATIVE_GLOBALS_H
+#define MOCK_NATIVE_GLOBALS_H
+
+#include <EEPROM.h>
+
+#include "common/log.h"
+#include "common/memory_stats.h"
+
+// What the sources built for env:native expect from the rest of the firmware. Every test links
+// all of them: include this in one file of each test.
+
+EEPROMClass EEPROM;
+uint64_t ramStatsUpdateIntervalMillis = 30000;
+
+// Logs go nowhere
+uint8_t logSinksFor(uint8_t, const char *) { return 0; }
+void logPrintf(uint8_t, uint8_t, const char *, const char *, ...) {}
+void logPrint(uint8_t, const char *) {}
+void logPrint(uint8_t, const __FlashStringHelper *) {}
+void logPrint(uint8_t, const String &) {}
+void logPrintln(uint8_t, const char *) {}
+void logPrintln(uint8_t, const __FlashStringHelper *) {}
+void logPrintln(uint8_t, const String &) {}
+void logPushBinary(uint8_t, uint8_t, uint32_t, const uint8_t *, size_t) {}
+
+#endif // MOCK_NATIVE_GLOBALS_H
@@ -0,0 +1,169 @@
+#include <unity.h>
+
+#include <native_globals.h>
+
+#include "common/eeprom_utils.tpp"
+
+/**
+ * A project struct at schema version 2, which added a field to version 1
+ */
+#pragma pack(push, 1)
+struct SensorConfigurationV1
+{
+    uint8_t pin;
+    uint16_t intervalSeconds;
+};
+
+struct SensorConfiguration
+{
+    static constexpr uint16_t SCHEMA_VERSION = 2;
+    static constexpr uint16_t EEPROM_CAPACITY = 16;
+
+    uint8_t pin;
+    uint16_t intervalSeconds;
+    uint16_t thresholdPercent;
+};
+#pragma pack(pop)
+
+constexpr int SENSOR_CONFIGURATION_EEPROM_ADDR = CommonEepromLayout::Append<SensorConfiguration>::address<SensorConfiguration>();
+
+static size_t upgradeSensorConfigurationV1(const uint8_t *oldData, size_t oldLength, uint8_t *newData)
+{
+    if (oldLength != sizeof(SensorConfigurationV1))
+        return 0;
+    SensorConfiguration configuration;
+    memcpy(&configuration, oldData, sizeof(SensorConfigurationV1));
+    configuration.thresholdPercent = 80;
+    memcpy(newData, &configuration, sizeof(configuration));
+    return sizeof(configuration);
+}
+
+// Loads an EEPROM image, as left by a previous firmware
+static void loadImage(const uint8_t *image)
+{
+    configStore.stage(0, image, EEPROM_SIZE);
+    configStore.commit();
+}
+
+static void writeLegacyStruct(uint8_t *image, int address, const void *data, size_t length)
+{
+    uint32_t checksum = 0;
+    for (size_t i = 0; i < length; i++)
+        checksum += static_cast<const uint8_t *>(data)[i];
+    memcpy(image + address, &checksum, sizeof(checksum));
+    memcpy(image + address + sizeof(checksum), data, length);
+}
+
+// The layout before record headers: QuickRestarts at 0, DeviceConfiguration right after it,
+// each one behind the byte sum of its bytes
+static void buildLegacyImage(uint8_t *image, uint8_t quickRestarts, const DeviceConfiguration &configuration)
+{
+    memset(image, 0xFF, EEPROM_SIZE);
+    writeLegacyStruct(image, 0, &quickRestarts, sizeof(quickRestarts));
+    writeLegacyStruct(image, sizeof(uint32_t) + sizeof(quickRestarts), &configuration, sizeof(configuration));
+}
+
+void setUp()
+{
+    uint8_t blank[EEPROM_SIZE];
+    memset(blank, 0xFF, sizeof(blank));
+    loadImage(blank);
+    registerEepromUpgrade<SensorConfiguration>(1, upgradeSensorConfigurationV1);
+}
+
+void tearDown() {}
+
+void test_legacy_image_is_imported()
+{
+    static_assert(sizeof(DeviceConfiguration) == 194, "the legacy importer expects the 194 byte DeviceConfiguration");
+    DeviceConfiguration stored("ssid", "password", "hostname", "device", "token");
+    uint8_t image[EEPROM_SIZE];
+    buildLegacyImage(image, 2, stored);
+    loadImage(image);
+
+    migrateCommonDataOnEeprom();
+
+    const DeviceConfiguration *configuration = readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR);
+    TEST_ASSERT_NOT_NULL(configuration);
+    TEST_ASSERT_EQUAL_MEMORY(&stored, configuration, sizeof(stored));
+    const QuickRestarts *quickRestarts = readDataFromEeprom<QuickRestarts>(JUST_RESTARTED_EEPROM_ADDR);
+    TEST_ASSERT_NOT_NULL(quickRestarts);
+    TEST_ASSERT_EQUAL_UINT8(2, quickRestarts->consecutiveQuickRestartsCount);
+}
+
+void test_legacy_image_with_a_bad_checksum_is_left_out()
+{
+    DeviceConfiguration stored("ssid", "password", "hostname", "device", "token");
+    uint8_t image[EEPROM_SIZE];
+    buildLegacyImage(image, 0, stored);
+    image[sizeof(uint32_t) + 1 + sizeof(uint32_t)] ^= 0x01; // a byte of the ssid
+    loadImage(image);
+
+    migrateCommonDataOnEeprom();
+
+    TEST_ASSERT_NULL(readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR));
+}
+
+void test_blank_image_imports_nothing()
+{
+    unsigned commits = EEPROM.commits;
+    migrateCommonDataOnEeprom();
+    TEST_ASSERT_EQUAL(commits, EEPROM.commits);
+    TEST_ASSERT_NULL(readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR));
+}
+
+void test_v1_record_is_migrated()
+{
+    SensorConfigurationV1 stored = {4, 600};
+    EepromTransaction transaction;
+    transaction.writeRecord(SENSOR_CONFIGURATION_EEPROM_ADDR, 1, &stored, sizeof(stored));
+    transaction.commit();
+    TEST_ASSERT_NULL(readDataFromEeprom<SensorConfiguration>(SENSOR_CONFIGURATION_EEPROM_ADDR));
+
+    TEST_ASSERT_TRUE(migrateEepromData<SensorConfiguration>(SENSOR_CONFIGURATION_EEPROM_ADDR));
+
+    const SensorConfiguration *configuration = readDataFromEeprom<SensorConfiguration>(SENSOR_CONFIGURATION_EEPROM_ADDR);
+    TEST_ASSERT_NOT_NULL(configuration);
+    TEST_ASSERT_EQUAL_UINT8(4, configuration->pin);
+    TEST_ASSERT_EQUAL_UINT16(600, configuration->intervalSeconds);
+    TEST_ASSERT_EQUAL_UINT16(80, configuration->thresholdPercent);
+    TEST_ASSERT_FALSE(migrateEepromData<SensorConfiguration>(SENSOR_CONFIGURATION_EEPROM_ADDR)); // current already
+}
+
+void test_corrupted_v1_record_is_not_migrated()
+{
+    SensorConfigurationV1 stored = {4, 600};
+    {
+        EepromTransaction transaction;
+        transaction.writeRecord(SENSOR_CONFIGURATION_EEPROM_ADDR, 1, &stored, sizeof(stored));
+        transaction.commit();
+    }
+    uint8_t flipped = configStore.view(SENSOR_CONFIGURATION_EEPROM_ADDR + sizeof(EepromRecordHeader), 1)[0] ^ 0x80;
+    configStore.stage(SENSOR_CONFIGURATION_EEPROM_ADDR + sizeof(EepromRecordHeader), &flipped, 1);
+    configStore.commit();
+
+    TEST_ASSERT_FALSE(migrateEepromData<SensorConfiguration>(SENSOR_CONFIGURATION_EEPROM_ADDR));
+    TEST_ASSERT_NULL(readDataFromEeprom<SensorConfiguration>(SENSOR_CONFIGURATION_EEPROM_ADDR));
+}
+
+void test_newer_record_is_not_migrated()
+{
+    SensorConfiguration stored = {4, 600, 80};
+    EepromTransaction transaction;
+    transaction.writeRecord(SENSOR_CONFIGURATION_EEPROM_ADDR, 3, &stored, sizeof(stored));
+    transaction.commit();
+
+    TEST_ASSERT_FALSE(migrateEepromData<SensorConfiguration>(SENSOR_CONFIGURATION_EEPROM_ADDR));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_legacy_image_is_imported);
+    RUN_TEST(test_legacy_image_with_a_bad_checksum_is_left_out);
+    RUN_TEST(test_blank_image_imports_nothing);
+    RUN_TEST(test_v1_record_is_migrated);
+    RUN_TEST(test_corrupted_v1_record_is_not_migrated);
+    RUN_TEST(test_newer_record_is_not_migrated);
+    return UNITY_END();
+}
@@ -0,0 +1,110 @@
+#include <unity.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <deque>
+#include <random>
+
+#include <native_globals.h>
+
+#include "common/memory_stats.h"
+
+void setUp() {}
+void tearDown() {}
+
+// Feeds the samples to MemoryStats and to a plain window, and returns the worst error of min/max/average
+template <typename NextSample>
+static uint32_t worstError(NextSample nextSample, size_t count)
+{
+    MemoryStats *stats = new MemoryStats();
+    std::deque<uint32_t> window;
+    uint32_t worst = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t sample = nextSample(i);
+        stats->addSample(sample);
+        window.push_back(sample);
+        if (window.size() > MemoryStats::sampleSize)
+            window.pop_front();
+
+        uint32_t min = *std::min_element(window.begin(), window.end());
+        uint32_t max = *std::max_element(window.begin(), window.end());
+        double sum = 0;
+        for (uint32_t value : window)
+            sum += value;
+        double average = sum / window.size();
+
+        worst = std::max<uint32_t>(worst, std::abs(static_cast<int64_t>(stats->getMin()) - min));
+        worst = std::max<uint32_t>(worst, std::abs(static_cast<int64_t>(stats->getMax()) - max));
+        worst = std::max<uint32_t>(worst, std::abs(stats->getAverage() - average));
+    }
+    delete stats;
+    return worst;
+}
+
+static int64_t clampHeap(int64_t value)
+{
+    return std::max<int64_t>(1000, std::min<int64_t>(300000, value));
+}
+
+void test_empty_window()
+{
+    MemoryStats stats;
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getMin());
+    TEST_ASSERT_EQUAL_UINT32(0, stats.getMax());
+    TEST_ASSERT_EQUAL_DOUBLE(0, stats.getAverage());
+}
+
+// Everything but the rollups takes at most a quarter of the std::vector<uint32_t> window it replaced
+void test_window_footprint()
+{
+    size_t rollups = sizeof(MemoryStats::minuteRollups) + sizeof(MemoryStats::hourRollups) + sizeof(MemoryStats::dayRollups);
+    TEST_ASSERT_LESS_OR_EQUAL(MemoryStats::sampleSize * sizeof(uint32_t) / 4, sizeof(MemoryStats) - rollups);
+}
+
+// Blocks spanning less than 127 quanta: samples are off by at most half a quantum
+void test_random_walk_error()
+{
+    std::mt19937 random(1);
+    int64_t heap = 150000;
+    uint32_t worst = worstError([&](size_t)
+                                { return heap = clampHeap(heap + static_cast<int32_t>(random() % 4001) - 2000); },
+                                20000);
+    TEST_ASSERT_LESS_OR_EQUAL(MEMORY_STATS_QUANTUM / 2, worst);
+}
+
+// 40 KB jumps: blocks span up to 254 quanta, one coarser frame
+void test_jumps_error()
+{
+    std::mt19937 random(2);
+    int64_t heap = 150000;
+    uint32_t worst = worstError([&](size_t i)
+                                {
+                                    heap += static_cast<int32_t>(random() % 4001) - 2000;
+                                    if (i % 500 == 0)
+                                        heap += random() % 2 ? 40000 : -40000;
+                                    return heap = clampHeap(heap); },
+                                20000);
+    TEST_ASSERT_LESS_OR_EQUAL(3 * MEMORY_STATS_QUANTUM / 2, worst);
+}
+
+// Samples all over 250 KB: blocks span up to 1016 quanta, shift 3
+void test_noise_error()
+{
+    std::mt19937 random(3);
+    uint32_t worst = worstError([&](size_t)
+                                { return 20000 + random() % 250000; },
+                                5000);
+    TEST_ASSERT_LESS_OR_EQUAL(15 * MEMORY_STATS_QUANTUM / 2, worst);
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_empty_window);
+    RUN_TEST(test_window_footprint);
+    RUN_TEST(test_random_walk_error);
+    RUN_TEST(test_jumps_error);
+    RUN_TEST(test_noise_error);
+    return UNITY_END();
+}
@@ -0,0 +1,81 @@
+#include <unity.h>
+
+#include <string>
+
+#include <native_globals.h>
+
+#include "common/metric_registry.h"
+
+static int32_t readOne() { return 1; }
+static int32_t readMin() { return INT32_MIN; }
+
+// What MetricsResponse sends: each metric rendered in a block, those that don't fit skipped
+static std::string scrape()
+{
+    std::string page;
+    char block[METRICS_BLOCK_SIZE];
+    for (size_t i = 0; i < getMetricCount(); i++)
+        page.append(block, renderMetric(i, block, sizeof(block)));
+    return page;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_long_help_is_rejected()
+{
+    static const std::string help(METRICS_BLOCK_SIZE, 'h');
+    size_t count = getMetricCount();
+    TEST_ASSERT_TRUE(registerMetric("app_short_total", "Short", METRIC_COUNTER, readOne));
+    TEST_ASSERT_FALSE(registerMetric("app_long_help_total", help.c_str(), METRIC_COUNTER, readOne));
+    TEST_ASSERT_TRUE(registerMetric("app_after_gauge", "After the long one", METRIC_GAUGE, readOne));
+    TEST_ASSERT_EQUAL(count + 2, getMetricCount());
+}
+
+void test_longest_metric_renders_in_full()
+{
+    // "# HELP n h\n# TYPE n gauge\nn -2147483648\n" with a one letter name
+    static const std::string help(METRICS_BLOCK_SIZE - 1 - 39, 'h');
+    TEST_ASSERT_TRUE(registerMetric("n", help.c_str(), METRIC_GAUGE, readMin));
+    TEST_ASSERT_FALSE(registerMetric("m", (help + "h").c_str(), METRIC_GAUGE, readMin));
+
+    char block[METRICS_BLOCK_SIZE];
+    size_t length = renderMetric(getMetricCount() - 1, block, sizeof(block));
+    TEST_ASSERT_EQUAL(METRICS_BLOCK_SIZE - 1, length);
+    TEST_ASSERT_EQUAL('\n', block[length - 1]);
+}
+
+void test_metric_that_does_not_fit_is_skipped()
+{
+    char block[16];
+    TEST_ASSERT_EQUAL(0, renderMetric(0, block, sizeof(block)));
+}
+
+void test_every_line_ends_with_a_newline()
+{
+    std::string page = scrape();
+    TEST_ASSERT_TRUE(page.size() > 0);
+    TEST_ASSERT_EQUAL('\n', page.back());
+
+    size_t start = 0;
+    while (start < page.size())
+    {
+        size_t end = page.find('\n', start);
+        TEST_ASSERT_TRUE(end != std::string::npos);
+        std::string line = page.substr(start, end - start);
+        // A cut line would have the next metric's HELP on its end
+        TEST_ASSERT_TRUE(line.find("# HELP", 1) == std::string::npos);
+        TEST_ASSERT_TRUE(line.find("app_long_help_total") == std::string::npos);
+        start = end + 1;
+    }
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_long_help_is_rejected);
+    RUN_TEST(test_longest_metric_renders_in_full);
+    RUN_TEST(test_metric_that_does_not_fit_is_skipped);
+    RUN_TEST(test_every_line_ends_with_a_newline);
+    return UNITY_END();
+}
@@ -0,0 +1,117 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdio>
+
+#include <native_globals.h>
+
+#include "common/eeprom_utils.tpp"
+
+static const DeviceConfiguration configuration("ssid", "password", "hostname", "device", "token");
+
+static EepromRecordHeader headerFor(const DeviceConfiguration &data)
+{
+    EepromRecordHeader header = {EEPROM_RECORD_MAGIC, DeviceConfiguration::SCHEMA_VERSION, sizeof(DeviceConfiguration), 0};
+    header.crc = calculateRecordCrc(header, &data);
+    return header;
+}
+
+// The checksum records had before the header
+static uint32_t byteSum(const void *data, size_t length)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i < length; i++)
+        sum += static_cast<const uint8_t *>(data)[i];
+    return sum;
+}
+
+// Runs f count times and returns the nanoseconds per run
+template <typename F>
+static double nanosecondsPerRun(F f, size_t count)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; i++)
+        f();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / count;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_crc32_check_value()
+{
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, calculateCrc32("123456789", 9));
+    TEST_ASSERT_EQUAL_HEX32(0, calculateCrc32("", 0));
+}
+
+void test_crc32_continues_over_buffers()
+{
+    const char *text = "The quick brown fox jumps over the lazy dog";
+    size_t length = strlen(text);
+    TEST_ASSERT_EQUAL_HEX32(calculateCrc32(text, length), calculateCrc32(text + 10, length - 10, calculateCrc32(text, 10)));
+}
+
+// Swapped or zeroed bytes left the byte sum as it was
+void test_record_crc_catches_what_byte_sum_missed()
+{
+    EepromRecordHeader header = headerFor(configuration);
+
+    DeviceConfiguration swapped = configuration;
+    std::swap(swapped.ssid[0], swapped.ssid[2]);
+    TEST_ASSERT_EQUAL_UINT32(byteSum(&configuration, sizeof(configuration)), byteSum(&swapped, sizeof(swapped)));
+    TEST_ASSERT_TRUE(header.crc != calculateRecordCrc(header, &swapped));
+
+    DeviceConfiguration zeroed("", "", "", "", "");
+    EepromRecordHeader zeroHeader = headerFor(zeroed);
+    TEST_ASSERT_EQUAL_UINT32(0, byteSum(&zeroed, sizeof(zeroed)));
+    TEST_ASSERT_TRUE(zeroHeader.crc != 0);
+}
+
+void test_record_crc_covers_the_header()
+{
+    EepromRecordHeader header = headerFor(configuration);
+    EepromRecordHeader otherVersion = header;
+    otherVersion.schemaVersion++;
+    TEST_ASSERT_TRUE(header.crc != calculateRecordCrc(otherVersion, &configuration));
+}
+
+// Host timings, printed to compare changes to the record check, not asserted
+void test_benchmark_record_check()
+{
+    const size_t runs = 200000;
+    EepromRecordHeader header = headerFor(configuration);
+    volatile uint32_t sink = 0;
+
+    double crc = nanosecondsPerRun([&]()
+                                   { sink = sink + (calculateRecordCrc(header, &configuration) == header.crc); },
+                                   runs);
+    double sum = nanosecondsPerRun([&]()
+                                   { sink = sink + byteSum(&configuration, sizeof(configuration)); },
+                                   runs);
+
+    uint8_t image[EEPROM_SIZE];
+    memset(image, 0xFF, sizeof(image));
+    configStore.stage(0, image, sizeof(image));
+    writeDataToEeprom(DEVICE_CONFIGURATION_EEPROM_ADDR, &configuration);
+    double cached = nanosecondsPerRun([&]()
+                                      { sink = sink + (readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR) != nullptr); },
+                                      runs);
+
+    char message[160];
+    snprintf(message, sizeof(message), "%u byte record: header + CRC32 %.0f ns, byte sum %.0f ns, cached read %.1f ns",
+             static_cast<unsigned>(sizeof(DeviceConfiguration)), crc, sum, cached);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_NOT_NULL(readDataFromEeprom<DeviceConfiguration>(DEVICE_CONFIGURATION_EEPROM_ADDR));
+}
+
+int main()
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_crc32_check_value);
+    RUN_TEST(test_crc32_continues_over_buffers);
+    RUN_TEST(test_record_crc_catches_what_byte_sum_missed);
+    RUN_TEST(test_record_crc_covers_the_header);
+    RUN_TEST(test_benchmark_record_check);
+    return UNITY_END();
+}
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""Renders the logs of a firmware built with -DLOG_BINARY (see src/common/log_binary.h).
+
+    log_decoder.py .pio/build/esp32dev/log_formats.json < capture.bin
+    pio device monitor --raw | log_decoder.py .pio/build/esp32dev/log_formats.json
+    log_decoder.py .pio/build/esp32dev/log_formats.json --ws ws://<hostname>/wsLogs
+
+log_formats.json is written by extra_script_log_formats.py at build time, and must come from the
+same build as the firmware. Bytes outside of binary records (boot messages, plain Serial prints)
+are passed through as they are. --ws needs the websocket-client package.
+"""
+
+import argparse
+import json
+import re
+import struct
+import sys
+
+RECORD_START = 0x1E
+HEADER = struct.Struct("<BBIIH")
+LEVELS = "?EWIDT"
+CONVERSION = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|j|z|t|L)?([diouxXeEfFgGaAcsp%])")
+
+
+class ArgReader:
+    def __init__(self, payload):
+        self.payload = payload
+        self.pos = 0
+
+    def take(self, fmt):
+        size = struct.calcsize(fmt)
+        value = struct.unpack_from(fmt, self.payload, self.pos)[0] if self.pos + size <= len(self.payload) else 0
+        self.pos += size
+        return value
+
+    def string(self):
+        length = self.take("<B")
+        value = self.payload[self.pos:self.pos + length].decode("utf-8", "replace")
+        self.pos += length
+        return value
+
+
+def render(fmt, payload):
+    args = ArgReader(payload)
+
+    def convert(match):
+        flags, width, precision, length, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        if width == "*":
+            width = str(args.take("<i"))
+        if precision == "*":
+            precision = str(args.take("<i"))
+        spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+        wide = length in ("ll", "j")
+        if conversion in "di":
+            return (spec + "d") % args.take("<q" if wide else "<i")
+        if conversion in "ouxX":
+            return (spec + conversion.replace("u", "d")) % args.take("<Q" if wide else "<I")
+        if conversion == "c":
+            return (spec + "c") % chr(args.take("<I") & 0xFF)
+        if conversion == "p":
+            return "0x%08x" % args.take("<I")
+        if conversion in "aA":
+            return float.hex(args.take("<d"))
+        if conversion in "eEfFgG":
+            return (spec + conversion) % args.take("<d")
+        return (spec + "s") % args.string()
+
+    return CONVERSION.sub(convert, fmt)
+
+
+class Decoder:
+    def __init__(self, formats, out):
+        self.formats = formats
+        self.out = out
+        self.buffer = bytearray()
+
+    def feed(self, data):
+        self.buffer += data
+        while self.buffer:
+            start = self.buffer.find(RECORD_START)
+            if start < 0:
+                self.passthrough(len(self.buffer))
+                break
+            if start > 0:
+                self.passthrough(start)
+            if len(self.buffer) < HEADER.size:
+                break
+            _, level, format_id, millis, length = HEADER.unpack_from(self.buffer)
+            if level >= len(LEVELS) or (format_id != 0 and f"{format_id:08x}" not in self.formats):
+                self.passthrough(1)  # not a record start
+                continue
+            if len(self.buffer) < HEADER.size + length:
+                break
+            payload = bytes(self.buffer[HEADER.size:HEADER.size + length])
+            del self.buffer[:HEADER.size + length]
+            self.record(level, format_id, millis, payload)
+        self.out.flush()
+
+    def passthrough(self, length):
+        self.out.write(self.buffer[:length].decode("utf-8", "replace"))
+        del self.buffer[:length]
+
+    def record(self, level, format_id, millis, payload):
+        if format_id == 0:
+            self.out.write(f"[{millis / 1000:10.3f}] {payload.decode('utf-8', 'replace')}")
+            return
+        entry = self.formats[f"{format_id:08x}"]
+        self.out.write(f"[{millis / 1000:10.3f}] {LEVELS[level]} [{entry['tag']}] {render(entry['format'], payload)}\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode binary logs (-DLOG_BINARY firmware).")
+    parser.add_argument("formats", help="log_formats.json from the firmware build directory")
+    parser.add_argument("input", nargs="?", default="-", help="capture file, '-' for stdin (default)")
+    parser.add_argument("--ws", metavar="URL", help="read from the logs websocket instead, e.g. ws://<hostname>/wsLogs")
+    options = parser.parse_args()
+
+    with open(options.formats) as file:
+        decoder = Decoder(json.load(file)["formats"], sys.stdout)
+
+    try:
+        if options.ws:
+            import websocket
+
+            connection = websocket.create_connection(options.ws)
+            while True:
+                frame = connection.recv()
+                decoder.feed(frame if isinstance(frame, bytes) else frame.encode())
+        else:
+            stream = sys.stdin.buffer if options.input == "-" else open(options.input, "rb")
+            while True:
+                data = stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+                if not data:
+                    break
+                decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()